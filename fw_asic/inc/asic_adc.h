@@ -1,5 +1,9 @@
 #pragma once
 #include "asic_common.h"
+#include "asic_spi.h"
+
+/* Transducer channels behind the load sense block of each asic */
+#define ASIC_LOAD_SENSE_CHANNELS 16
 
 /**
  * @brief ADC channels
@@ -18,14 +22,43 @@ typedef enum {
   kADCChannel_Total
 } ADCChannels;
 
+asicState asic_chain_adc_set_clock_divider(asic_chain* chain, uint16_t clock_divider);
+asicState asic_chain_adc_set_load_sense_timing(asic_chain* chain, uint16_t charge_time,
+                                               uint16_t measure_time);
+asicState asic_chain_adc_set_load_sense_config(asic_chain* chain, uint16_t pF_trim);
+asicState asic_chain_adc_init(asic_chain* chain);
+asicState asic_chain_adc_init_broadcast(asic_chain* chain, uint8_t address_mask);
+asicState asic_chain_adc_start_sample(asic_chain* chain);
+asicState asic_chain_adc_sync(asic_chain* chain);
+asicState asic_chain_adc_set_channel(asic_chain* chain, ADCChannels adc_channel);
+asicState asic_chain_adc_load_sense_hold(asic_chain* chain);
+bool asic_chain_adc_ready(asic_chain* chain);
+asicState asic_chain_adc_done_irq_enable(asic_chain* chain, uint8_t gpio_channel);
+void asic_chain_adc_done_irq_disable(asic_chain* chain);
+void asic_chain_adc_done_isr(asic_chain* chain, uint8_t address);
+asicState asic_chain_adc_get_value(asic_chain* chain, uint16_t* reading);
+asicState asic_chain_adc_load_sense_sel(asic_chain* chain, ADCChannels channel);
+asicState asic_chain_adc_load_sense_map(asic_chain* chain, uint8_t address_mask,
+                                        uint16_t channel_mask, uint16_t* map);
+asicState asic_chain_adc_scan(asic_chain* chain, const ADCChannels* channels,
+                              uint8_t channel_count, uint8_t address_mask, uint16_t* results);
+
+/* Default chain */
 asicState asic_adc_set_load_sense_timing(uint16_t charge_time, uint16_t measure_time);
 asicState asic_adc_set_load_sense_config(uint16_t cap_trim);
 asicState asic_adc_load_sense_sel(ADCChannels channel);
 asicState asic_adc_load_sense_hold(void);
+asicState asic_adc_load_sense_map(uint8_t address_mask, uint16_t channel_mask, uint16_t* map);
 asicState asic_adc_sync(void);
 
 asicState asic_adc_set_channel(ADCChannels channel);
 asicState asic_adc_start_sample(void);
 asicState asic_adc_get_value(uint16_t* reading);
 bool asic_adc_ready(void);
+asicState asic_adc_done_irq_enable(uint8_t gpio_channel);
+void asic_adc_done_irq_disable(void);
+void asic_adc_done_isr(uint8_t address);
 asicState asic_adc_init(void);
+asicState asic_adc_init_broadcast(uint8_t address_mask);
+asicState asic_adc_scan(const ADCChannels* channels, uint8_t channel_count, uint8_t address_mask,
+                        uint16_t* results);
@@ -0,0 +1,73 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "asic_adc.h"
+#include "asic_common.h"
+#include "asic_spi.h"
+
+/* Copies asic_adc_stream_stats tries before reporting the statistics busy */
+#define ASIC_ADC_STREAM_STATS_RETRIES 8
+
+/**
+ * @brief One stored ADC sample, the mean of decimation readings
+ */
+typedef struct {
+  uint32_t time; /* Timestamp of the last reading, 0 without a clock */
+  uint16_t value;
+  uint8_t address;
+  uint8_t channel; /* ADCChannels */
+} asic_adc_sample;
+
+/**
+ * @brief Running statistics of the readings of one channel of one asic
+ */
+typedef struct {
+  uint32_t count; /* Readings since the last reset */
+  uint16_t min;
+  uint16_t max;
+  uint16_t mean; /* Filled in by asic_adc_stream_stats */
+  uint64_t sum;
+} asic_adc_stats;
+
+/**
+ * @brief ADC acquisition pipeline, owned by the caller
+ *
+ * One producer (the acquisition task or interrupt) pushes readings, one consumer takes stored
+ * samples straight out of the ring. Statistics are kept for every reading and can be read from
+ * any context, a reader that interrupts the producer mid update gets kAsiceERR.
+ */
+typedef struct {
+  asic_chain* chain;
+  asic_adc_sample* ring;
+  uint32_t mask;         /* Ring size - 1 */
+  _Atomic uint32_t head; /* Next sample written by the producer */
+  _Atomic uint32_t tail; /* Next sample taken by the consumer */
+  uint16_t decimation;   /* Readings averaged into each stored sample */
+  uint32_t (*timestamp)(void);
+  uint32_t pending_sum[ASIC_MAX_DEVICES][kADCChannel_Total];
+  uint16_t pending[ASIC_MAX_DEVICES][kADCChannel_Total]; /* Readings towards the next sample */
+  asic_adc_stats stats[ASIC_MAX_DEVICES][kADCChannel_Total];
+  /* Odd while the producer updates the stats of that channel */
+  _Atomic uint32_t stats_sequence[ASIC_MAX_DEVICES][kADCChannel_Total];
+  atomic_bool stats_reset;   /* Statistics cleared by the next push */
+  _Atomic uint32_t overruns; /* Samples dropped because the ring was full */
+} asic_adc_stream;
+
+asicState asic_chain_adc_stream_init(asic_chain* chain, asic_adc_stream* stream,
+                                     asic_adc_sample* ring, uint32_t size, uint16_t decimation);
+void asic_adc_stream_set_clock(asic_adc_stream* stream, uint32_t (*timestamp)(void));
+void asic_adc_stream_push(asic_adc_stream* stream, uint8_t address, ADCChannels channel,
+                          uint16_t value);
+asicState asic_adc_stream_acquire(asic_adc_stream* stream, const ADCChannels* channels,
+                                  uint8_t channel_count, uint8_t address_mask);
+uint32_t asic_adc_stream_peek(asic_adc_stream* stream, const asic_adc_sample** samples);
+void asic_adc_stream_release(asic_adc_stream* stream, uint32_t count);
+asicState asic_adc_stream_stats(asic_adc_stream* stream, uint8_t address, ADCChannels channel,
+                                asic_adc_stats* snapshot);
+void asic_adc_stream_stats_reset(asic_adc_stream* stream);
+
+/* Default chain */
+asicState asic_adc_stream_init(asic_adc_stream* stream, asic_adc_sample* ring, uint32_t size,
+                               uint16_t decimation);
@@ -0,0 +1,52 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "asic_common.h"
+#include "asic_pwm.h"
+#include "asic_pwm_stream.h"
+
+/* Transducers on a full chain, index address * ASIC_PWM_CHANNELS + channel */
+#define ASIC_FOCUS_TRANSDUCERS (ASIC_MAX_DEVICES * ASIC_PWM_CHANNELS)
+/* Focal points combined into one frame */
+#define ASIC_FOCUS_MAX_POINTS 8
+/* Amplitude of a focal point driven at full duty */
+#define ASIC_FOCUS_AMPLITUDE_MAX 0xFFFF
+
+/**
+ * @brief Transducer positions of a chain in um, one array per axis
+ */
+typedef struct {
+  int32_t x[ASIC_FOCUS_TRANSDUCERS];
+  int32_t y[ASIC_FOCUS_TRANSDUCERS];
+  int32_t z[ASIC_FOCUS_TRANSDUCERS];
+} asic_focus_geometry;
+
+/**
+ * @brief One focal point
+ */
+typedef struct {
+  int32_t x;          /* um */
+  int32_t y;          /* um */
+  int32_t z;          /* um */
+  uint16_t amplitude; /* 0 - ASIC_FOCUS_AMPLITUDE_MAX */
+} asic_focus_point;
+
+/**
+ * @brief Delay and duty computation for a phased array, owned by the caller
+ *
+ * Integer only, so it runs on cores without an FPU. Phases are in 1/65536 turns.
+ */
+typedef struct {
+  const asic_focus_geometry* geometry;
+  uint8_t address_mask; /* Asics computed, the rest of the frame is left unchanged */
+  uint16_t period;      /* PWM clocks per carrier cycle */
+  uint32_t wavelength;  /* um */
+  uint64_t turns;       /* 2^48 / wavelength, rounded up */
+} asic_focus;
+
+asicState asic_focus_init(asic_focus* focus, const asic_focus_geometry* geometry,
+                          uint8_t address_mask, uint32_t pwm_clock, uint32_t frequency,
+                          uint32_t speed_of_sound);
+asicState asic_focus_compute(const asic_focus* focus, const asic_focus_point* points,
+                             uint16_t count, asic_pwm_frame* frame);
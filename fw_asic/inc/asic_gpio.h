@@ -1,6 +1,7 @@
 #pragma once
 
 #include "asic_common.h"
+#include "asic_spi.h"
 
 /**
  * @brief Output for GPIO
@@ -37,9 +38,22 @@ typedef enum {
   kGPIO_All = 0x0F
 } GpioChanReg;
 
+asicState asic_chain_gpio_output_enable(asic_chain* chain, uint16_t gpio_bit_mask);
+asicState asic_chain_gpio_output_select(asic_chain* chain, uint8_t gpio_channel, GpioOutSel outsel);
+asicState asic_chain_gpio_route(asic_chain* chain, uint8_t address_mask, uint8_t gpio_channel,
+                                GpioOutSel outsel);
+asicState asic_chain_gpio_write(asic_chain* chain, uint16_t gpio_chan_reg);
+void asic_chain_gpio_init(asic_chain* chain);
+void asic_chain_gpio_init_broadcast(asic_chain* chain, uint8_t address_mask);
+asicState asic_chain_gpio_read(asic_chain* chain, uint16_t* data);
+asicState asic_chain_pwm_mux_select(asic_chain* chain, uint8_t gpio_channel, uint16_t channel);
+
+/* Default chain */
 void asic_gpio_init(void);
+void asic_gpio_init_broadcast(uint8_t address_mask);
 asicState asic_gpio_output_enable(uint16_t gpio_bit_mask);
 asicState asic_gpio_output_select(uint8_t gpio_channel, GpioOutSel outsel);
+asicState asic_gpio_route(uint8_t address_mask, uint8_t gpio_channel, GpioOutSel outsel);
 asicState asic_gpio_write(uint16_t gpio_chan_reg);
 asicState asic_gpio_read(uint16_t* data);
-void asic_pwm_mux_select(uint16_t gpio_pwm_channel, uint16_t channel);
+asicState asic_pwm_mux_select(uint8_t gpio_channel, uint16_t channel);
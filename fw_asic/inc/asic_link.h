@@ -0,0 +1,39 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "asic_common.h"
+#include "asic_regs.h"
+#include "asic_spi.h"
+
+/**
+ * @brief Link training settings
+ */
+typedef struct {
+  uint32_t min_speed;      /* Hz, slowest clock tried */
+  uint32_t max_speed;      /* Hz, fastest clock tried */
+  uint32_t step;           /* Hz between the clocks tried */
+  uint8_t margin;          /* Percent taken off the fastest clock that passed */
+  uint8_t address_mask;    /* Bit n set to check asic address n */
+  asicReg test_reg;        /* Written with test patterns, restored afterwards */
+  int8_t crc_gpio;         /* Asic GPIO routed to the CRC error flag, -1 for none */
+  bool (*crc_error)(void); /* Optional, latched pin wired to crc_gpio, true on new error */
+} asic_link_config;
+
+/**
+ * @brief Trained SPI link of one chain, owned by the caller
+ */
+typedef struct {
+  asic_chain* chain;
+  asic_link_config config;
+  uint32_t fastest;    /* Fastest clock that passed training */
+  uint32_t step_downs; /* Clock reductions since training */
+} asic_link;
+
+asicState asic_chain_link_train(asic_chain* chain, asic_link* link,
+                                const asic_link_config* config);
+asicState asic_link_step_down(asic_link* link);
+asicState asic_link_check(asic_link* link);
+
+/* Default chain */
+asicState asic_link_train(asic_link* link, const asic_link_config* config);
\ No newline at end of file
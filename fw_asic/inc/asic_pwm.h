@@ -3,16 +3,48 @@
 #include <stdint.h>
 
 #include "asic_common.h"
+#include "asic_spi.h"
 
+/* PWM channels per asic */
+#define ASIC_PWM_CHANNELS 16
+/* REG_PWM_CONFIG bit that latches new duty and delay values */
+#define ASIC_PWM_SYNC (1 << 15)
+
+asicState asic_chain_pwm_sync(asic_chain* chain);
+asicState asic_chain_pwm_short_circuit_protection_control(asic_chain* chain, bool enable,
+                                                          uint16_t sc_filter);
+asicState asic_chain_pwm_short_circuit_clear(asic_chain* chain);
+asicState asic_chain_pwm_short_circuit_get(asic_chain* chain, uint16_t* shorts);
+asicState asic_chain_pwm_delay_set(asic_chain* chain, uint16_t delay, uint16_t channel, bool sync);
+asicState asic_chain_pwm_duty_set(asic_chain* chain, uint16_t duty, uint16_t channel, bool sync);
+asicState asic_chain_pwm_set_frame(asic_chain* chain, const uint16_t* duty, const uint16_t* delay,
+                                   uint16_t channel_mask);
+asicState asic_chain_pwm_set_highz(asic_chain* chain, bool enable_highz);
+asicState asic_chain_pwm_enable(asic_chain* chain, bool enable_PWM);
+asicState asic_chain_pwm_set_config(asic_chain* chain, bool enable_linear_mode,
+                                    bool enable_count_from_centre);
+asicState asic_chain_pwm_dither(asic_chain* chain, bool enable_asic_pwm_dither);
+asicState asic_chain_pwm_init(asic_chain* chain, bool enable_sc, uint8_t sc_filter,
+                              bool enable_linear_mode, bool enable_asic_pwm_dither,
+                              bool enable_count_from_centre);
+asicState asic_chain_pwm_init_broadcast(asic_chain* chain, uint8_t address_mask, bool enable_sc,
+                                        uint8_t sc_filter, bool enable_linear_mode,
+                                        bool enable_asic_pwm_dither, bool enable_count_from_centre);
+
+/* Default chain */
 asicState asic_pwm_sync(void);
 asicState asic_pwm_short_circuit_protection_control(bool enable, uint16_t sc_filter);
 asicState asic_pwm_short_circuit_clear(void);
 asicState asic_pwm_short_circuit_get(uint16_t* shorts);
 asicState asic_pwm_delay_set(uint16_t delay, uint16_t channel, bool sync);
 asicState asic_pwm_duty_set(uint16_t duty, uint16_t channel, bool sync);
+asicState asic_pwm_set_frame(const uint16_t* duty, const uint16_t* delay, uint16_t channel_mask);
 asicState asic_pwm_set_highz(bool enable_highz);
 asicState asic_pwm_enable(bool enable_PWM);
 asicState asic_pwm_set_config(bool enable_linear_mode, bool enable_count_from_centre);
 asicState asic_pwm_dither(bool enable_asic_pwm_dither);
 asicState asic_pwm_init(bool enable_sc, uint8_t sc_filter, bool enable_linear_mode,
-                        bool enable_asic_pwm_dither, bool enable_count_from_centre);
\ No newline at end of file
+                        bool enable_asic_pwm_dither, bool enable_count_from_centre);
+asicState asic_pwm_init_broadcast(uint8_t address_mask, bool enable_sc, uint8_t sc_filter,
+                                  bool enable_linear_mode, bool enable_asic_pwm_dither,
+                                  bool enable_count_from_centre);
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "asic_common.h"
+#include "asic_pwm.h"
+#include "asic_spi.h"
+
+/* Duty and delay of every channel plus one sync, per asic */
+#define ASIC_PWM_STREAM_FRAMES (ASIC_MAX_DEVICES * ((2 * ASIC_PWM_CHANNELS) + 1))
+
+/**
+ * @brief Duty and delay of every PWM channel of every asic for one update
+ */
+typedef struct {
+  uint16_t duty[ASIC_MAX_DEVICES][ASIC_PWM_CHANNELS];
+  uint16_t delay[ASIC_MAX_DEVICES][ASIC_PWM_CHANNELS];
+} asic_pwm_frame;
+
+/**
+ * @brief PWM frame playback, owned by the caller
+ *
+ * The application fills the ring, the driver drains it one frame per update period. While one
+ * frame is on the bus the next is already patched into the other buffer, which the SPI driver
+ * sends without a copy.
+ */
+typedef struct {
+  asic_chain* chain;
+  uint8_t address_mask; /* Asics updated by each frame */
+  asic_pwm_frame* ring;
+  uint16_t ring_size;
+  volatile uint16_t head; /* Next slot filled by the application */
+  volatile uint16_t tail; /* Next slot staged by the driver */
+  uint16_t ticks_per_frame;
+  uint16_t ticks;
+  uint16_t sync[ASIC_MAX_DEVICES];            /* PWM_CONFIG value with the sync bit set */
+  uint32_t frames[2][ASIC_PWM_STREAM_FRAMES]; /* Encoded at init, only the data is patched */
+  uint16_t count;                             /* Frames per buffer */
+  uint8_t staged;                             /* Buffer holding the next frame */
+  volatile bool staged_ready;
+  _Atomic uint8_t in_flight; /* Holds on the send path, the frame on the bus and its sender */
+  atomic_bool overdue;       /* Frame due, sent by whichever interrupt frees the send path */
+  volatile bool running;
+  asic_request request;
+  volatile uint32_t sent;
+  volatile uint32_t underruns; /* Update periods with no frame in the ring */
+  _Atomic uint32_t late;       /* Frames that started after their update period */
+  volatile uint32_t errors;    /* Frames dropped by a failed transfer */
+} asic_pwm_stream;
+
+asicState asic_chain_pwm_stream_init(asic_chain* chain, asic_pwm_stream* stream,
+                                     asic_pwm_frame* ring, uint16_t ring_size,
+                                     uint8_t address_mask, uint16_t ticks_per_frame);
+asic_pwm_frame* asic_pwm_stream_next(asic_pwm_stream* stream);
+asicState asic_pwm_stream_push(asic_pwm_stream* stream);
+asicState asic_pwm_stream_start(asic_pwm_stream* stream);
+void asic_pwm_stream_stop(asic_pwm_stream* stream);
+void asic_pwm_stream_tick(asic_pwm_stream* stream);
+uint16_t asic_pwm_stream_free(const asic_pwm_stream* stream);
+
+/* Default chain */
+asicState asic_pwm_stream_init(asic_pwm_stream* stream, asic_pwm_frame* ring, uint16_t ring_size,
+                               uint8_t address_mask, uint16_t ticks_per_frame);
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "asic_common.h"
+#include "asic_spi.h"
+
+/* Commands drained into one SPI transfer */
+#define ASIC_QUEUE_BATCH 32
+
+/**
+ * @brief One queued register access, or a batch of write frames
+ */
+typedef struct {
+  uint32_t frame;
+  const uint32_t* frames; /* Batch sent instead of frame, NULL for a single frame */
+  uint16_t count;         /* Frames in the batch */
+  asic_request* request;  /* Completion slot, NULL for a write nobody waits on */
+  uint32_t time;          /* Timestamp when queued, 0 without a clock */
+} asic_command;
+
+/**
+ * @brief Ring slot, the sequence tells producers and the owner whose turn it is
+ */
+typedef struct {
+  _Atomic uint32_t sequence;
+  asic_command command;
+} asic_queue_slot;
+
+/**
+ * @brief Lock free multi producer, single consumer command ring, owned by the caller
+ *
+ * Any task or interrupt enqueues encoded commands without taking the bus lock. One owner
+ * context drains the ring in order into transfers of up to ASIC_QUEUE_BATCH frames, so commands
+ * from one producer reach the bus in the order they were queued.
+ */
+typedef struct {
+  asic_chain* chain;
+  asic_queue_slot* slots;
+  uint32_t mask;               /* Ring size - 1 */
+  _Atomic uint32_t head;       /* Next position claimed by a producer */
+  uint32_t tail;               /* Next position drained by the owner */
+  _Atomic uint32_t full;       /* Commands refused because the ring was full */
+  uint32_t commands;           /* Commands drained */
+  uint32_t transfers;          /* Transfers sent by the owner */
+  uint32_t (*timestamp)(void); /* Optional, free running counter for queueing latency */
+} asic_queue;
+
+/**
+ * @brief Traffic classes of the scheduler, most urgent first
+ */
+typedef enum {
+  kAsicClass_Safety,       /* Short reads, emergency high-Z */
+  kAsicClass_Control,      /* PWM and ADC updates of the control loop */
+  kAsicClass_Housekeeping, /* Init tables, load sense, diagnostics */
+  kAsicClass_Count
+} asicClass;
+
+/**
+ * @brief One traffic class of the scheduler
+ */
+typedef struct {
+  asic_queue queue;
+  asic_command current; /* Command being sent, valid while active */
+  bool active;
+  uint16_t sent;    /* Frames of the current batch already sent */
+  uint32_t latency; /* Queued to first frame on the bus of the last command, in ticks */
+  uint32_t latency_max;
+  uint32_t preemptions; /* Batches of this class paused for a more urgent class */
+} asic_sched_class;
+
+/**
+ * @brief Priority scheduler of the traffic on one chain, owned by the caller
+ *
+ * Producers queue commands per class from any task or interrupt. The owner always sends from
+ * the most urgent class with work, and sends batches of less urgent classes slice frames at a
+ * time, so a safety command waits at most one slice of background traffic.
+ */
+typedef struct {
+  asic_chain* chain;
+  uint16_t slice;                  /* Frames sent before more urgent classes are checked */
+  uint8_t address_mask;            /* Asics covered by asic_sched_highz */
+  uint16_t sync[ASIC_MAX_DEVICES]; /* PWM_CONFIG value with the sync bit set */
+  asicClass last;                  /* Class of the last transfer */
+  asic_sched_class classes[kAsicClass_Count];
+} asic_sched;
+
+asicState asic_chain_queue_init(asic_chain* chain, asic_queue* queue, asic_queue_slot* slots,
+                                uint32_t size);
+asicState asic_queue_write(asic_queue* queue, uint32_t address, asicReg reg, uint16_t data,
+                           asic_request* request);
+asicState asic_queue_read(asic_queue* queue, uint32_t address, asicReg reg, uint16_t* data,
+                          asic_request* request);
+asicState asic_queue_submit(asic_queue* queue, const uint32_t* frames, uint16_t count,
+                            asic_request* request);
+asicState asic_queue_service(asic_queue* queue);
+
+asicState asic_chain_sched_init(asic_chain* chain, asic_sched* sched, asic_queue_slot* slots,
+                                uint32_t size, uint16_t slice, uint8_t address_mask);
+void asic_sched_set_clock(asic_sched* sched, uint32_t (*timestamp)(void));
+asicState asic_sched_write(asic_sched* sched, asicClass priority, uint32_t address, asicReg reg,
+                           uint16_t data, asic_request* request);
+asicState asic_sched_read(asic_sched* sched, asicClass priority, uint32_t address, asicReg reg,
+                          uint16_t* data, asic_request* request);
+asicState asic_sched_submit(asic_sched* sched, asicClass priority, const uint32_t* frames,
+                            uint16_t count, asic_request* request);
+asicState asic_sched_highz(asic_sched* sched, uint8_t address_mask);
+asicState asic_sched_service(asic_sched* sched);
+
+/* Default chain */
+asicState asic_queue_init(asic_queue* queue, asic_queue_slot* slots, uint32_t size);
+asicState asic_sched_init(asic_sched* sched, asic_queue_slot* slots, uint32_t size,
+                          uint16_t slice, uint8_t address_mask);
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "asic_common.h"
+#include "asic_spi.h"
+
+/**
+ * @brief Short circuit monitor of a set of asics on one chain, owned by the caller
+ *
+ * The asic SC detect output is routed to a GPIO whose host pin interrupt calls
+ * asic_short_monitor_isr. A task then calls asic_short_monitor_service, which reads
+ * REG_SHORT_DETECT from every monitored asic in one transfer, optionally puts the shorted asics
+ * into high-Z, clears the flags it saw and reports them.
+ */
+typedef struct asic_short_monitor {
+  asic_chain* chain;
+  uint8_t address_mask; /* Monitored asics */
+  bool highz;           /* High-Z shorted asics before reporting */
+  /* Optional, called from asic_short_monitor_service when a short was seen */
+  void (*callback)(struct asic_short_monitor* monitor);
+  void* context;                   /* Free for the callback's use */
+  uint32_t (*timestamp)(void);     /* Optional, free running counter for response latency */
+  uint16_t sync[ASIC_MAX_DEVICES]; /* PWM_CONFIG value with the sync bit set */
+  volatile bool triggered;
+  volatile uint32_t trigger_time;
+  uint16_t shorts[ASIC_MAX_DEVICES]; /* Channel bitmap per asic address from the last service */
+  uint8_t shorted;                   /* Bit n set if asic n reported a short */
+  uint32_t events;                   /* Services that found a short */
+  uint32_t latency;                  /* Trigger to high-Z of the last event, in ticks */
+  uint32_t latency_max;
+} asic_short_monitor;
+
+asicState asic_chain_short_monitor_init(asic_chain* chain, asic_short_monitor* monitor,
+                                        uint8_t address_mask, int8_t gpio_channel, bool highz);
+void asic_short_monitor_isr(asic_short_monitor* monitor);
+asicState asic_short_monitor_service(asic_short_monitor* monitor);
+asicState asic_short_monitor_poll(asic_short_monitor* monitor);
+
+/* Default chain */
+asicState asic_short_monitor_init(asic_short_monitor* monitor, uint8_t address_mask,
+                                  int8_t gpio_channel, bool highz);
@@ -1,18 +1,241 @@
 #pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "Driver_SPI.h"
 #include "asic_common.h"
 #include "asic_regs.h"
 
+/* 28:26 - ADev, Device address */
+#define ASIC_MAX_DEVICES 8
+/* Broadcast mask covering every asic on the chain */
+#define ASIC_ALL_DEVICES 0xFF
+/* 25:18 - AReg, Register address */
+#define ASIC_MAX_REGS 256
+/* Chains that can be initialised at the same time (one SPI event handler each) */
+#define ASIC_MAX_CHAINS 4
+/* 15:0 - WD/RD, Write/Read data */
+#define ASIC_FRAME_DATA_MASK 0x0000FFFFU
+
+/* Frame without its data, a compile time constant for a known asic and register */
+#define ASIC_FRAME_HEADER(address, reg, read)               \
+  ((((uint32_t)(address) & (ASIC_MAX_DEVICES - 1)) << 26) | \
+   (((uint32_t)(reg) & (ASIC_MAX_REGS - 1)) << 18) | ((read) ? 0x00010000U : 0))
+/* Frame with its data field replaced */
+#define ASIC_FRAME_PATCH(frame, data) \
+  (((frame) & ~ASIC_FRAME_DATA_MASK) | ((uint32_t)(data) & ASIC_FRAME_DATA_MASK))
+
+/**
+ * @brief Copy of the last value written to each register of each asic on the chain
+ */
+typedef struct {
+  uint16_t value[ASIC_MAX_DEVICES][ASIC_MAX_REGS];
+  uint8_t valid[ASIC_MAX_DEVICES][ASIC_MAX_REGS / 8];
+} asic_shadow;
+
 typedef struct {
   ARM_DRIVER_SPI* spi;
   void (*lockSem)(void);
   void (*unlockSem)(void);
+  /* Optional, take the semaphore without blocking (callable from an interrupt), true if taken */
+  bool (*tryLockSem)(void);
   void (*setCS)(void);
   void (*clearCS)(void);
+  asic_shadow* shadow; /* Optional, NULL disables the register shadow */
 } asic_spi_struct;
 
+#ifdef ASIC_INSTRUMENTATION
+/* Latency histogram buckets, bucket 0 counts 0 ticks and bucket n counts [2^(n-1), 2^n) */
+#define ASIC_STATS_BUCKETS 33
+
+/**
+ * @brief Bus usage counters of one chain
+ *
+ * Times are in ticks of the timestamp hook and stay 0 without one.
+ */
+typedef struct {
+  uint32_t (*timestamp)(void); /* Optional, free running counter (cycle counter, clock_gettime) */
+  uint32_t transfers;
+  uint32_t frames; /* Register frames, each also costs a reset frame */
+  uint32_t reset_frames;
+  uint32_t reads[ASIC_MAX_REGS];
+  uint32_t writes[ASIC_MAX_REGS];
+  uint32_t device_reads[ASIC_MAX_DEVICES];
+  uint32_t device_writes[ASIC_MAX_DEVICES];
+  uint32_t lock_wait[ASIC_STATS_BUCKETS]; /* Time spent waiting for the bus */
+  uint32_t latency[ASIC_STATS_BUCKETS];   /* Transfer submit to completion */
+  uint32_t lock_wait_max;
+  uint32_t latency_max;
+  uint64_t busy_time; /* Sum of transfer latencies */
+  uint32_t submit_time;
+} asic_stats;
+#endif
+
+/**
+ * @brief CRC check and retransmission counters of one chain
+ */
+typedef struct {
+  uint32_t checks;      /* Batches and writes checked after sending */
+  uint32_t crc_errors;  /* Checks that found corrupted writes */
+  uint32_t retransmits; /* Frames sent again */
+  uint32_t failures;    /* Checks still failing after every retry */
+} asic_retry_stats;
+
+/**
+ * @brief State of an asynchronous request
+ */
+typedef enum {
+  kAsicRequest_Idle,
+  kAsicRequest_Pending,
+  kAsicRequest_Done,
+  kAsicRequest_Error
+} asicRequestState;
+
+/**
+ * @brief Asynchronous register access, owned by the caller
+ */
+typedef struct asic_request {
+  volatile asicRequestState state;
+  uint16_t* data; /* Read destination */
+  /* Optional, called from the SPI interrupt once the request has completed */
+  void (*callback)(struct asic_request* request);
+  void* context; /* Free for the callback's use */
+  uint32_t frame;
+  uint32_t read_data;
+} asic_request;
+
+/**
+ * @brief Frames being clocked out by the SPI interrupt (driver private)
+ */
+typedef struct {
+  const uint32_t* tx;
+  uint32_t* rx;    /* NULL for write only transfers */
+  uint16_t period; /* Frames in tx, sent repeatedly until count frames have gone */
+  uint16_t count;
+  uint16_t index;
+  bool reset; /* Reset frame (CS high) in progress */
+  volatile int32_t status;
+  asic_request* request; /* Asynchronous request to complete, NULL if blocking */
+  uint32_t frame;        /* Storage for single register transfers */
+  uint32_t read_data;
+} asic_transfer;
+
+/**
+ * @brief One chain of asics on one SPI peripheral
+ */
+typedef struct {
+  asic_spi_struct spi;              /* Copy of the struct passed to asic_chain_init */
+  void (*callback)(uint32_t event); /* Interrupt callback, NULL for the flag system */
+  atomic_bool busy;
+  uint32_t address;
+  uint32_t speed;         /* SPI clock in Hz */
+  uint8_t broadcast_mask; /* Non zero while broadcasting */
+  asic_transfer transfer;
+  bool adc_done_irq;         /* ADC completion signalled by asic_chain_adc_done_isr */
+  _Atomic uint8_t adc_done;  /* Bit n set by asic_chain_adc_done_isr for asic address n */
+  _Atomic uint8_t adc_armed; /* Bit n set while a conversion of address n is started */
+  uint16_t adc_done_checks;  /* Flag checks since the last ADC_DONE bus poll */
+  bool (*crc_error)(void);   /* Optional, latched CRC error pin, read after each check */
+  uint8_t retries;           /* Retransmissions per check, 0 disables checking */
+  asic_retry_stats retry;
+#ifdef ASIC_INSTRUMENTATION
+  asic_stats stats;
+#endif
+} asic_chain;
+
+/**
+ * @brief Register writes sent to a chain as one transfer
+ */
+typedef struct {
+  asic_chain* chain;
+  uint32_t* frames;
+  uint16_t capacity;
+  uint16_t count;
+} asic_batch;
+
+/**
+ * @brief One entry of a register initialisation table
+ */
+typedef struct {
+  asicReg reg;
+  uint16_t value;
+} asic_reg_write;
+
+asic_chain* asic_default_chain(void);
+asicState asic_chain_init(asic_chain* chain, asic_spi_struct* spi_struct,
+                          void (*callback)(uint32_t event));
+asicState asic_chain_set_address(asic_chain* chain, uint32_t address);
+asicState asic_chain_set_speed(asic_chain* chain, uint32_t speed);
+asicState asic_chain_write(asic_chain* chain, asicReg reg, uint16_t data);
+asicState asic_chain_read(asic_chain* chain, asicReg reg, uint16_t* data);
+asicState asic_chain_read_burst(asic_chain* chain, const asicReg* regs, uint16_t count,
+                                uint16_t* data);
+asicState asic_chain_read_each(asic_chain* chain, uint8_t address_mask, asicReg reg,
+                               uint16_t* data);
+asicState asic_chain_transfer_frames(asic_chain* chain, const uint32_t* tx, uint32_t* rx,
+                                     uint16_t count);
+asicState asic_chain_submit_frames(asic_chain* chain, const uint32_t* frames, uint16_t count,
+                                   asic_request* request);
+asicState asic_chain_try_submit_frames(asic_chain* chain, const uint32_t* frames,
+                                       uint16_t count, asic_request* request);
+asicState asic_chain_broadcast_begin(asic_chain* chain, uint8_t address_mask);
+asicState asic_chain_broadcast_end(asic_chain* chain);
+asicState asic_chain_broadcast_write(asic_chain* chain, uint8_t address_mask, asicReg reg,
+                                     uint16_t data);
+asicState asic_chain_write_async(asic_chain* chain, asicReg reg, uint16_t data,
+                                 asic_request* request);
+asicState asic_chain_read_async(asic_chain* chain, asicReg reg, uint16_t* data,
+                                asic_request* request);
+asicState asic_chain_read_cached(asic_chain* chain, asicReg reg, uint16_t* data);
+void asic_chain_shadow_invalidate(asic_chain* chain);
+bool asic_chain_shadow_get(const asic_chain* chain, uint32_t address, asicReg reg,
+                           uint16_t* data);
+asicState asic_chain_shadow_resync(asic_chain* chain);
+asicState asic_chain_batch_begin(asic_chain* chain, asic_batch* batch, uint32_t* frames,
+                                 uint16_t capacity);
+asicState asic_chain_write_table(asic_chain* chain, const asic_reg_write* table, uint16_t count,
+                                 bool verify);
+asicState asic_chain_set_retransmit(asic_chain* chain, bool (*crc_error)(void), uint8_t retries);
+void asic_chain_retry_snapshot(const asic_chain* chain, asic_retry_stats* snapshot);
+
+/* Default chain */
 asicState asic_initSPI(asic_spi_struct* spi_struct, void (*callback)(uint32_t event));
+asicState asic_set_speed(uint32_t speed);
 asicState asic_write(asicReg reg, uint16_t data);
 asicState asic_read(asicReg reg, uint16_t* data);
+asicState asic_read_burst(const asicReg* regs, uint16_t count, uint16_t* data);
+asicState asic_read_each(uint8_t address_mask, asicReg reg, uint16_t* data);
+asicState asic_transfer_frames(const uint32_t* tx, uint32_t* rx, uint16_t count);
+asicState asic_submit_frames(const uint32_t* frames, uint16_t count, asic_request* request);
+asicState asic_try_submit_frames(const uint32_t* frames, uint16_t count, asic_request* request);
+asicState asic_broadcast_begin(uint8_t address_mask);
+asicState asic_broadcast_end(void);
+asicState asic_broadcast_write(uint8_t address_mask, asicReg reg, uint16_t data);
+asicState asic_write_async(asicReg reg, uint16_t data, asic_request* request);
+asicState asic_read_async(asicReg reg, uint16_t* data, asic_request* request);
+asicState asic_read_cached(asicReg reg, uint16_t* data);
+void asic_shadow_invalidate(void);
+asicState asic_shadow_resync(void);
+asicState asic_batch_begin(asic_batch* batch, uint32_t* frames, uint16_t capacity);
+asicState asic_write_table(const asic_reg_write* table, uint16_t count, bool verify);
+asicState asic_set_retransmit(bool (*crc_error)(void), uint8_t retries);
+void asic_retry_snapshot(asic_retry_stats* snapshot);
+
+uint32_t asic_frame_encode(uint32_t address, asicReg reg, bool read, uint16_t data);
+void asic_frames_patch(uint32_t* frames, const uint16_t* data, uint16_t count);
+bool asic_request_done(const asic_request* request);
+asicState asic_batch_write(asic_batch* batch, asicReg reg, uint16_t data);
+asicState asic_batch_write_to(asic_batch* batch, uint32_t address, asicReg reg, uint16_t data);
+asicState asic_batch_submit(asic_batch* batch);
+asicState asic_batch_submit_repeat(asic_batch* batch, uint16_t repeat);
+asicState asic_batch_submit_async(asic_batch* batch, asic_request* request);
+
+#ifdef ASIC_INSTRUMENTATION
+void asic_chain_stats_set_clock(asic_chain* chain, uint32_t (*timestamp)(void));
+void asic_chain_stats_snapshot(const asic_chain* chain, asic_stats* snapshot);
+void asic_chain_stats_reset(asic_chain* chain);
+void asic_stats_set_clock(uint32_t (*timestamp)(void));
+void asic_stats_snapshot(asic_stats* snapshot);
+void asic_stats_reset(void);
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "asic_common.h"
+#include "asic_spi.h"
+
+/**
+ * @brief Staged register values of every asic on a chain, owned by the caller
+ *
+ * Writes land here first. A commit sends only the registers whose staged value differs from
+ * the register shadow (the last committed state), then one PWM sync per asic written.
+ */
+typedef struct {
+  asic_chain* chain;
+  uint16_t value[ASIC_MAX_DEVICES][ASIC_MAX_REGS];
+  uint8_t dirty[ASIC_MAX_DEVICES][ASIC_MAX_REGS / 8]; /* Staged value not committed yet */
+  uint8_t written;                                    /* Bit n set if asic n was staged */
+  uint32_t writes;                                    /* Staged writes since the last commit */
+  uint32_t frames;                                    /* Frames sent by commits, syncs included */
+  uint32_t saved;                                     /* Frames saved by commits */
+} asic_stage;
+
+asicState asic_chain_stage_init(asic_chain* chain, asic_stage* stage);
+void asic_stage_write(asic_stage* stage, uint32_t address, asicReg reg, uint16_t data);
+asicState asic_stage_commit(asic_stage* stage, uint32_t* saved);
+void asic_stage_discard(asic_stage* stage);
+
+/* Default chain */
+asicState asic_stage_init(asic_stage* stage);
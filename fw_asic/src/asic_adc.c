@@ -1,57 +1,82 @@
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 
 #include "asic_adc.h"
 #include "asic_common.h"
+#include "asic_gpio.h"
 #include "asic_regs.h"
 #include "asic_spi.h"
 
+static const uint16_t kAdcSync = 1 << 6;
+static const uint16_t kAdcDoneChecks = 64; /* Flag checks between bus polls in interrupt mode */
+
 /**
- * @brief Initialise ADC bits
+ * @brief Completion flag bits of the asics addressed by the chain
  *
- * @return asicState
+ * @param chain [in] Asic chain
+ * @return uint8_t
  */
-static asicState init_tbit(void) {
-  /*
-   * TBIT_SET_BIT_STOP <12:15> = 10
-   * TBIT_SET_BIT_START <8:11> = 10
-   * TBIT_CMP_EN         <4:7> = 10
-   * TBIT_BIT_LEN        <0:3> = 10
-   */
-  static const uint16_t TBIT_CONFIG = 0xAAAA;
-  asicState state = asic_write(REG_ADC_TBIT_CONFIG, TBIT_CONFIG);
-  if (kAsiceSuccess != state) {
-    return state;
-  }
+static uint8_t done_mask(const asic_chain* chain) {
+  return (0 != chain->broadcast_mask) ? chain->broadcast_mask : (1 << chain->address);
+}
 
-  /*
-   * TBIT_ENABLE_OP <0:3> = 10
-   * TBIT_LTCH      <4:7> = 10
-   */
-  static const uint16_t TBIT_START_TIMES = 0x00AA;
-  return asic_write(REG_ADC_TBIT_START_TIMES, TBIT_START_TIMES);
+/**
+ * @brief Clear the completion flags of a set of asics and ignore their edges until re-armed
+ *
+ * @param chain [in] Asic chain
+ * @param mask [in] Bit n set for asic address n
+ */
+static void done_disarm(asic_chain* chain, uint8_t mask) {
+  atomic_fetch_and(&chain->adc_armed, (uint8_t)~mask);
+  atomic_fetch_and(&chain->adc_done, (uint8_t)~mask);
+  chain->adc_done_checks = 0;
 }
 
 /**
- * @brief Initialise pulse config
+ * @brief Clear the completion flags of a set of asics and accept completions from now on
  *
- * @return asicState
+ * A completion signalled before the call can't mark the new conversion done.
+ *
+ * @param chain [in] Asic chain
+ * @param mask [in] Bit n set for asic address n
  */
-static asicState init_tconf(void) {
-  asicState state = kAsiceERR;
-  do {
+static void done_arm(asic_chain* chain, uint8_t mask) {
+  done_disarm(chain, mask);
+  atomic_fetch_or(&chain->adc_armed, mask);
+}
+
+/**
+ * @brief ADC initialisation, written in order by asic_chain_adc_init
+ */
+static const asic_reg_write kAdcInitTable[] = {
+    /* Clock divider */
+    {REG_ADC_CLK, 0x0006},
+
+    /*
+     * TBIT_SET_BIT_STOP <12:15> = 10
+     * TBIT_SET_BIT_START <8:11> = 10
+     * TBIT_CMP_EN         <4:7> = 10
+     * TBIT_BIT_LEN        <0:3> = 10
+     */
+    {REG_ADC_TBIT_CONFIG, 0xAAAA},
+    /*
+     * TBIT_ENABLE_OP <0:3> = 10
+     * TBIT_LTCH      <4:7> = 10
+     */
+    {REG_ADC_TBIT_START_TIMES, 0x00AA},
+
+    /* Load sense measure time <8:15> = 20, charge time <0:7> = 20 pwm pulses */
+    {REG_ADC_LOAD_SENSE_CONFIG, 0x1414},
+
     /*
      * PULSE_SH_START1 <0:5> = 16
      * PULSE_SH_STOP1 <6:11> = 31
      * PULSE_SH_START2 <0:5> = 36
      * PULSE_SH_STOP2 <6:11> = 51
      */
-    static const uint16_t pulseStartStop1 = 0x07D0;
-    static const uint16_t pulseStartStop2 = 0x1476;
-    if ((kAsiceSuccess != asic_write(REG_ADC_PULSE_START_STOP1, pulseStartStop1)) ||
-        (kAsiceSuccess != asic_write(REG_ADC_PULSE_START_STOP2, pulseStartStop2))) {
-      break;
-    }
+    {REG_ADC_PULSE_START_STOP1, 0x07D0},
+    {REG_ADC_PULSE_START_STOP2, 0x1476},
 
     /*
      * PULSE_SH_SMALL_START1 <0:5> = 16
@@ -59,12 +84,8 @@ static asicState init_tconf(void) {
      * PULSE_SH_SMALL_START2 <0:5> = 36
      * PULSE_SH_SMALL_STOP2 <6:11> = 52
      */
-    static const uint16_t pulseSmallStartStop1 = 0x0810;
-    static const uint16_t pulseSmallStartStop2 = 0x0D24;
-    if ((kAsiceSuccess != asic_write(REG_ADC_PULSE_SMALL_START_STOP1, pulseSmallStartStop1)) ||
-        (kAsiceSuccess != asic_write(REG_ADC_PULSE_SMALL_START_STOP2, pulseSmallStartStop2))) {
-      break;
-    }
+    {REG_ADC_PULSE_SMALL_START_STOP1, 0x0810},
+    {REG_ADC_PULSE_SMALL_START_STOP2, 0x0D24},
 
     /*
      * PULSE_SHRT_IP_START1 <0:5> = 0
@@ -72,12 +93,8 @@ static asicState init_tconf(void) {
      * PULSE_SHRT_IP_START2 <0:5> = 0
      * PULSE_SHRT_IP_STOP2 <6:11> = 0
      */
-    static const uint16_t pulseShortIpStartStop1 = 0x0840;
-    static const uint16_t pulseShortIpStartStop2 = 0x0000;
-    if ((kAsiceSuccess != asic_write(REG_ADC_PULSE_SMALL_START_STOP1, pulseShortIpStartStop1)) ||
-        (kAsiceSuccess != asic_write(REG_ADC_PULSE_SMALL_START_STOP2, pulseShortIpStartStop2))) {
-      break;
-    }
+    {REG_ADC_PULSE_SMALL_START_STOP1, 0x0840},
+    {REG_ADC_PULSE_SMALL_START_STOP2, 0x0000},
 
     /*
      * PULSE_AZ1_START1 <0:5> = 0
@@ -85,12 +102,8 @@ static asicState init_tconf(void) {
      * PULSE_AZ1_START2 <0:5> = 0
      * PULSE_AZ1_STOP2 <6:11> = 0
      */
-    static const uint16_t pulseAz1StartStop1 = 0x0880;
-    static const uint16_t pulseAz1StartStop2 = 0x0000;
-    if ((kAsiceSuccess != asic_write(REG_ADC_PULSE_AZ1_START_STOP1, pulseAz1StartStop1)) ||
-        (kAsiceSuccess != asic_write(REG_ADC_PULSE_AZ1_START_STOP2, pulseAz1StartStop2))) {
-      break;
-    }
+    {REG_ADC_PULSE_AZ1_START_STOP1, 0x0880},
+    {REG_ADC_PULSE_AZ1_START_STOP2, 0x0000},
 
     /*
      * PULSE_AZ2_START1 <0:5> = 0
@@ -98,12 +111,8 @@ static asicState init_tconf(void) {
      * PULSE_AZ2_START2 <0:5> = 0
      * PULSE_AZ2_STOP2 <6:11> = 0
      */
-    static const uint16_t pulseAz2StartStop1 = 0x08C0;
-    static const uint16_t pulseAz2StartStop2 = 0x0000;
-    if ((kAsiceSuccess != asic_write(REG_ADC_PULSE_AZ2_START_STOP1, pulseAz2StartStop1)) ||
-        (kAsiceSuccess != asic_write(REG_ADC_PULSE_AZ2_START_STOP2, pulseAz2StartStop2))) {
-      break;
-    }
+    {REG_ADC_PULSE_AZ2_START_STOP1, 0x08C0},
+    {REG_ADC_PULSE_AZ2_START_STOP2, 0x0000},
 
     /*
      * PULSE_RESET_BIT_START1 <0:5> = 0
@@ -111,12 +120,8 @@ static asicState init_tconf(void) {
      * PULSE_RESET_BIT_START2 <0:5> = 0
      * PULSE_RESET_BIT_STOP2 <6:11> = 0
      */
-    static const uint16_t pulseResetBitStartStop1 = 0x0080;
-    static const uint16_t pulseResetBitStartStop2 = 0x0000;
-    if ((kAsiceSuccess != asic_write(REG_ADC_PULSE_RST_BIT_START_STOP1, pulseResetBitStartStop1)) ||
-        (kAsiceSuccess != asic_write(REG_ADC_PULSE_RST_BIT_START_STOP2, pulseResetBitStartStop2))) {
-      break;
-    }
+    {REG_ADC_PULSE_RST_BIT_START_STOP1, 0x0080},
+    {REG_ADC_PULSE_RST_BIT_START_STOP2, 0x0000},
 
     /*
      * PULSE_RESET_LS_HALF_START1 <0:5> = 16
@@ -124,144 +129,152 @@ static asicState init_tconf(void) {
      * PULSE_RESET_LS_HALF_START2 <0:5> = 36
      * PULSE_RESET_LS_HALF_STOP2 <6:11> = 51
      */
-    static const uint16_t pulseResetLsHalfStartStop1 = 0x07D0;
-    static const uint16_t pulseResetLsHalfStartStop2 = 0x0CE4;
-    if ((kAsiceSuccess !=
-         asic_write(REG_ADC_PULSE_RST_HALF_START_STOP1, pulseResetLsHalfStartStop1)) ||
-        (kAsiceSuccess !=
-         asic_write(REG_ADC_PULSE_RST_HALF_START_STOP2, pulseResetLsHalfStartStop2))) {
-      break;
-    }
+    {REG_ADC_PULSE_RST_HALF_START_STOP1, 0x07D0},
+    {REG_ADC_PULSE_RST_HALF_START_STOP2, 0x0CE4},
 
     /* Must be 53 (0x35) or less */
-    static const uint16_t bitStart = 0x0035;
-    if (kAsiceSuccess != asic_write(REG_ADC_BIT_START, bitStart)) {
-      break;
-    }
+    {REG_ADC_BIT_START, 0x0035},
 
-    state = kAsiceSuccess;
-  } while (0);
-  return state;
-}
+    /* Load sense capacitance trim, 9pF - 2 */
+    {REG_ANA_CONFIG_LOAD_SENSE, 0x0007},
+};
 
 /**
  * @brief Set the ADC clock divider
  *
+ * @param chain [in] Asic chain
  * @param clock_divider[in] (4 bits) clock division
  * @return asicState
  */
-asicState adc_set_clock_divider(uint16_t clock_divider) {
-  return asic_write(REG_ADC_CLK, clock_divider);
+asicState asic_chain_adc_set_clock_divider(asic_chain* chain, uint16_t clock_divider) {
+  return asic_chain_write(chain, REG_ADC_CLK, clock_divider);
 }
 
 /**
  * @brief Set load sense timings
  *
+ * @param chain [in] Asic chain
  * @param charge_time [in] Given in pwm pulses
  * @param measure_time [in] Given in pwm pulses
  * @return asicState
  */
-asicState asic_adc_set_load_sense_timing(uint16_t charge_time, uint16_t measure_time) {
+asicState asic_chain_adc_set_load_sense_timing(asic_chain* chain, uint16_t charge_time,
+                                               uint16_t measure_time) {
   uint16_t data = (measure_time << 8) | charge_time;
-  return asic_write(REG_ADC_LOAD_SENSE_CONFIG, data);
+  return asic_chain_write(chain, REG_ADC_LOAD_SENSE_CONFIG, data);
 }
 
 /**
  * @brief Set load sense configuration
  *
+ * @param chain [in] Asic chain
  * @param pF_trim [in] Capacitance trim 2-9pF
  * @return asicState
  */
-asicState asic_adc_set_load_sense_config(uint16_t pF_trim) {
+asicState asic_chain_adc_set_load_sense_config(asic_chain* chain, uint16_t pF_trim) {
   if ((pF_trim < 2) || (pF_trim > 9)) {
     return kAsiceERR;
   }
   // capacitance in pF - 2 = capacitance trim value
   pF_trim -= 2;
-  return asic_write(REG_ANA_CONFIG_LOAD_SENSE, pF_trim);
+  return asic_chain_write(chain, REG_ANA_CONFIG_LOAD_SENSE, pF_trim);
 }
 
 /**
  * @brief Initialise the ADC.
  *
+ * @param chain [in] Asic chain
  * @return asicState
  */
-asicState asic_adc_init(void) {
-  static const uint16_t ADC_CLK_DIV = 0x0006;
-  static const uint16_t CHARGE_TIME = 20;
-  static const uint16_t MEASURE_TIME = 20;
-  static const uint16_t CAP_TRIM = 9;
-
-  if ((kAsiceSuccess != adc_set_clock_divider(ADC_CLK_DIV)) || (kAsiceSuccess != init_tbit()) ||
-      (kAsiceSuccess != asic_adc_set_load_sense_timing(CHARGE_TIME, MEASURE_TIME)) ||
-      (kAsiceSuccess != init_tconf()) ||
-      (kAsiceSuccess != asic_adc_set_load_sense_config(CAP_TRIM))) {
+asicState asic_chain_adc_init(asic_chain* chain) {
+  return asic_chain_write_table(chain, kAdcInitTable,
+                                sizeof(kAdcInitTable) / sizeof(kAdcInitTable[0]), false);
+}
+
+/**
+ * @brief Initialise the ADC of every asic in the mask at once
+ *
+ * @param chain [in] Asic chain
+ * @param address_mask [in] Bit n set for asic address n
+ * @return asicState
+ */
+asicState asic_chain_adc_init_broadcast(asic_chain* chain, uint8_t address_mask) {
+  if (kAsiceSuccess != asic_chain_broadcast_begin(chain, address_mask)) {
     return kAsiceERR;
   }
-  return kAsiceSuccess;
+
+  asicState state = asic_chain_adc_init(chain);
+  asic_chain_broadcast_end(chain);
+  return state;
 }
 
 /**
  * @brief Start the ADC sampling
  *
+ * @param chain [in] Asic chain
  * @return asicState
  */
-asicState asic_adc_start_sample(void) {
+asicState asic_chain_adc_start_sample(asic_chain* chain) {
   static const uint16_t ADC_EN = 1 << 3;
   uint16_t data;
-  asicState state = asic_read(REG_ADC_STATE, &data);
+  asicState state = asic_chain_read_cached(chain, REG_ADC_STATE, &data);
   if (kAsiceSuccess > state) {
     return state;
   }
 
   data |= ADC_EN;
-  return asic_write(REG_ADC_STATE, data);
+  done_arm(chain, done_mask(chain));
+  return asic_chain_write(chain, REG_ADC_STATE, data);
 }
 
 /**
  * @brief Generate ADC sync pulse
  *
+ * @param chain [in] Asic chain
  * @return asicState
  */
-asicState asic_adc_sync(void) {
-  static const uint16_t asic_adc_sync = 1 << 6;
+asicState asic_chain_adc_sync(asic_chain* chain) {
   uint16_t data;
-  asicState state = asic_read(REG_ADC_STATE, &data);
+  asicState state = asic_chain_read_cached(chain, REG_ADC_STATE, &data);
   if (kAsiceSuccess > state) {
     return state;
   }
 
-  data |= asic_adc_sync;
-  return asic_write(REG_ADC_STATE, data);
+  data |= kAdcSync;
+  return asic_chain_write(chain, REG_ADC_STATE, data);
 }
 
 /**
  * @brief Sets the ADC Channel
  *
+ * @param chain [in] Asic chain
  * @param adc_channel [in] (3 bits) Requested channel
  * @return asicState
  */
-asicState asic_adc_set_channel(ADCChannels adc_channel) {
+asicState asic_chain_adc_set_channel(asic_chain* chain, ADCChannels adc_channel) {
   static const uint16_t channel_mask = 0x7;
   uint16_t data;
-  asicState state = asic_read(REG_ADC_STATE, &data);
+  asicState state = asic_chain_read_cached(chain, REG_ADC_STATE, &data);
   if (kAsiceSuccess > state) {
     return state;
   }
 
   data &= ~channel_mask;
   data |= (uint16_t)adc_channel;
-  return asic_write(REG_ADC_STATE, data);
+  return asic_chain_write(chain, REG_ADC_STATE, data);
 }
 
 /**
  * @brief Load sense hold
  *
+ * The sync pulses are built from the cached timing and ADC state and sent as one burst.
+ *
+ * @param chain [in] Asic chain
  * @return asicState
  */
-asicState asic_adc_load_sense_hold(void) {
+asicState asic_chain_adc_load_sense_hold(asic_chain* chain) {
   uint16_t data;
-  asicState state = asic_read(REG_ADC_LOAD_SENSE_CONFIG, &data);
+  asicState state = asic_chain_read_cached(chain, REG_ADC_LOAD_SENSE_CONFIG, &data);
   if (kAsiceSuccess > state) {
     return state;
   }
@@ -272,36 +285,121 @@ asicState asic_adc_load_sense_hold(void) {
 
   /* TODO: I don't know what this is doing. It was part of the ESP code */
   uint16_t pulse_number = charge_time + measure_time + 3;
-  for (uint16_t pulse = 0; pulse < pulse_number; pulse++) {
-    if (kAsiceSuccess != asic_adc_sync()) {
-      return kAsiceERR;
-    }
+
+  state = asic_chain_read_cached(chain, REG_ADC_STATE, &data);
+  if (kAsiceSuccess > state) {
+    return state;
   }
-  return kAsiceSuccess;
+
+  uint32_t frames[ASIC_MAX_DEVICES];
+  asic_batch batch;
+  if ((kAsiceSuccess != asic_chain_batch_begin(chain, &batch, frames, ASIC_MAX_DEVICES)) ||
+      (kAsiceSuccess != asic_batch_write(&batch, REG_ADC_STATE, data | kAdcSync))) {
+    return kAsiceERR;
+  }
+  return asic_batch_submit_repeat(&batch, pulse_number);
 }
 
 /**
- * @brief ADC ready?
+ * @brief Read ADC_DONE of the current asic over the bus
  *
+ * @param chain [in] Asic chain
  * @return true yes
  * @return false no
  */
-bool asic_adc_ready(void) {
+static bool adc_done_polled(asic_chain* chain) {
   uint16_t data = 0;
-  asic_read(REG_ADC_STATE, &data);
+  asic_chain_read(chain, REG_ADC_STATE, &data);
 
   static const uint16_t ADC_DONE = 0x10;
   return (0 != (data & ADC_DONE));
 }
 
+/**
+ * @brief ADC ready?
+ *
+ * In interrupt completion mode this checks the flag set by asic_chain_adc_done_isr, and only
+ * reads ADC_DONE over the bus once every kAdcDoneChecks calls without it, so polling loops still
+ * finish if a completion is never signalled.
+ *
+ * @param chain [in] Asic chain
+ * @return true yes
+ * @return false no
+ */
+bool asic_chain_adc_ready(asic_chain* chain) {
+  if (chain->adc_done_irq) {
+    if (0 != (atomic_load(&chain->adc_done) & done_mask(chain))) {
+      chain->adc_done_checks = 0;
+      return true;
+    }
+    if (++chain->adc_done_checks < kAdcDoneChecks) {
+      return false;
+    }
+    chain->adc_done_checks = 0;
+  }
+  return adc_done_polled(chain);
+}
+
+/**
+ * @brief Signal ADC completion of the current asic (or broadcast mask) through
+ * asic_chain_adc_done_isr
+ *
+ * kGPIOOutsel_ADCSyncToggle is routed to the GPIO. That pin toggles on every ADC sync, i.e.
+ * every REG_ADC_STATE write with the sync bit, not at the end of a conversion, so it only shows
+ * that a sync burst has landed. asic_chain_adc_done_isr must be called from whatever tells the
+ * host a conversion has finished, e.g. a timer started with the conversion. Completions are cleared
+ * when a conversion is started and ignored for asics with none started.
+ * asic_chain_adc_ready then mostly checks the flag and falls back to the bus now and then.
+ *
+ * @param chain [in] Asic chain
+ * @param gpio_channel [in] 0 - 3 GPIO channel
+ * @return asicState
+ */
+asicState asic_chain_adc_done_irq_enable(asic_chain* chain, uint8_t gpio_channel) {
+  if (kAsiceSuccess !=
+      asic_chain_gpio_route(chain, done_mask(chain), gpio_channel, kGPIOOutsel_ADCSyncToggle)) {
+    return kAsiceERR;
+  }
+
+  done_disarm(chain, 0xFF);
+  chain->adc_done_irq = true;
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Return to polling ADC_DONE over the bus
+ *
+ * The GPIO routing is left unchanged.
+ *
+ * @param chain [in] Asic chain
+ */
+void asic_chain_adc_done_irq_disable(asic_chain* chain) {
+  chain->adc_done_irq = false;
+}
+
+/**
+ * @brief ADC completion hook, call from the host interrupt that signals the end of a conversion
+ *
+ * Ignored for an asic with no conversion started since the last clear.
+ *
+ * @param chain [in] Asic chain
+ * @param address [in] Address of the asic whose conversion finished
+ */
+void asic_chain_adc_done_isr(asic_chain* chain, uint8_t address) {
+  if ((address < ASIC_MAX_DEVICES) && (0 != (atomic_load(&chain->adc_armed) & (1 << address)))) {
+    atomic_fetch_or(&chain->adc_done, (uint8_t)(1 << address));
+  }
+}
+
 /**
  * @brief Get the ADC reading
  *
+ * @param chain [in] Asic chain
  * @param reading [in/out] reading value
  * @return asicState
  */
-asicState asic_adc_get_value(uint16_t* reading) {
-  asicState state = asic_read(REG_ADC_VAL, reading);
+asicState asic_chain_adc_get_value(asic_chain* chain, uint16_t* reading) {
+  asicState state = asic_chain_read(chain, REG_ADC_VAL, reading);
   if (kAsiceSuccess > state) {
     return state;
   }
@@ -309,16 +407,318 @@ asicState asic_adc_get_value(uint16_t* reading) {
   return kAsiceSuccess;
 }
 
+/**
+ * @brief Wait until the conversion of the current asic has finished
+ *
+ * Gives up after ADC_READY_POLLS bus polls. In interrupt completion mode asic_chain_adc_ready
+ * polls once every kAdcDoneChecks calls, so a missed completion only slows the wait down.
+ *
+ * @param chain [in] Asic chain
+ * @return asicState
+ */
+static asicState wait_done(asic_chain* chain) {
+  static const uint32_t ADC_READY_POLLS = 1000;
+  uint32_t checks = ADC_READY_POLLS * (chain->adc_done_irq ? kAdcDoneChecks : 1);
+  for (uint32_t check = 0; check < checks; check++) {
+    if (asic_chain_adc_ready(chain)) {
+      return kAsiceSuccess;
+    }
+  }
+  return kAsiceERR;
+}
+
+/**
+ * @brief Sample a list of channels on a set of asics
+ *
+ * Channel select and start are one write of REG_ADC_STATE. The first channel is started on
+ * every asic in one batch, then each asic is read out in turn and immediately started on its
+ * next channel, so it converts while the others are read.
+ *
+ * @param chain [in] Asic chain
+ * @param channels [in] Channels to sample, in order
+ * @param channel_count [in] Number of channels
+ * @param address_mask [in] Bit n set for asic address n
+ * @param results [out] channel_count * asics readings, results[(c * asics) + a] for channel c of
+ * the a-th lowest address in the mask
+ * @return asicState
+ */
+asicState asic_chain_adc_scan(asic_chain* chain, const ADCChannels* channels,
+                              uint8_t channel_count, uint8_t address_mask, uint16_t* results) {
+  static const uint16_t CHANNEL_MASK = 0x7;
+  static const uint16_t ADC_EN = 1 << 3;
+  if ((NULL == channels) || (NULL == results) || (0 == channel_count) || (0 == address_mask)) {
+    return kAsiceERR;
+  }
+
+  uint8_t addresses[ASIC_MAX_DEVICES];
+  uint16_t adc_state[ASIC_MAX_DEVICES];
+  uint8_t asics = 0;
+  uint32_t address = chain->address;
+  asicState state = kAsiceSuccess;
+
+  uint32_t frames[ASIC_MAX_DEVICES];
+  asic_batch batch;
+  asic_chain_batch_begin(chain, &batch, frames, ASIC_MAX_DEVICES);
+  for (uint8_t i = 0; i < ASIC_MAX_DEVICES; i++) {
+    if (0 == (address_mask & (1 << i))) {
+      continue;
+    }
+
+    uint16_t data;
+    if ((kAsiceSuccess != asic_chain_set_address(chain, i)) ||
+        (kAsiceSuccess > asic_chain_read_cached(chain, REG_ADC_STATE, &data))) {
+      state = kAsiceERR;
+      break;
+    }
+
+    adc_state[asics] = data & ~(CHANNEL_MASK | ADC_EN);
+    addresses[asics] = i;
+    asic_batch_write_to(&batch, i, REG_ADC_STATE,
+                        adc_state[asics] | (uint16_t)channels[0] | ADC_EN);
+    asics++;
+  }
+  if (kAsiceSuccess == state) {
+    done_arm(chain, address_mask);
+    state = asic_batch_submit(&batch);
+  }
+
+  for (uint8_t c = 0; (c < channel_count) && (kAsiceSuccess == state); c++) {
+    for (uint8_t a = 0; (a < asics) && (kAsiceSuccess == state); a++) {
+      if ((kAsiceSuccess != asic_chain_set_address(chain, addresses[a])) ||
+          (kAsiceSuccess != wait_done(chain)) ||
+          (kAsiceSuccess != asic_chain_adc_get_value(chain, &results[(c * asics) + a]))) {
+        state = kAsiceERR;
+      } else if ((c + 1) < channel_count) {
+        done_arm(chain, (uint8_t)(1 << addresses[a]));
+        state = asic_chain_write(chain, REG_ADC_STATE,
+                                 adc_state[a] | (uint16_t)channels[c + 1] | ADC_EN);
+      }
+    }
+  }
+
+  asic_chain_set_address(chain, address);
+  return state;
+}
+
+/**
+ * @brief Deselect every load sense input of a set of asics
+ *
+ * @param chain [in] Asic chain
+ * @param address_mask [in] Bit n set for asic address n
+ * @return asicState
+ */
+static asicState load_sense_release(asic_chain* chain, uint8_t address_mask) {
+  return asic_chain_broadcast_write(chain, address_mask, REG_ADC_LOAD_SENSE, 0x0000);
+}
+
+/**
+ * @brief Measure the load of the same transducer channel on every asic in parallel
+ *
+ * Every asic is held and converts together, so a channel costs one hold on the whole chain
+ * rather than one per asic. Reading the results and selecting the next channel go out as one
+ * transfer. The select is always a single bit, moved straight to the next channel, and cleared
+ * on every asic at the end. The asics must share the same load sense timing.
+ *
+ * @param chain [in] Asic chain
+ * @param address_mask [in] Bit n set for asic address n
+ * @param channel_mask [in] Bit n set to measure transducer channel n
+ * @param map [out] ASIC_MAX_DEVICES * ASIC_LOAD_SENSE_CHANNELS load sense readings,
+ * map[(address * ASIC_LOAD_SENSE_CHANNELS) + channel], channels not measured are left unchanged
+ * @return asicState
+ */
+asicState asic_chain_adc_load_sense_map(asic_chain* chain, uint8_t address_mask,
+                                        uint16_t channel_mask, uint16_t* map) {
+  static const uint16_t CHANNEL_MASK = 0x7;
+  static const uint16_t ADC_EN = 1 << 3;
+  static const uint16_t BYTE_MASK = 0x00FF;
+  if ((NULL == map) || (0 == address_mask) || (0 == channel_mask)) {
+    return kAsiceERR;
+  }
+
+  uint8_t addresses[ASIC_MAX_DEVICES];
+  uint16_t adc_state[ASIC_MAX_DEVICES];
+  uint16_t timing = 0;
+  uint8_t asics = 0;
+  uint32_t address = chain->address;
+  asicState state = kAsiceSuccess;
+  for (uint8_t i = 0; (i < ASIC_MAX_DEVICES) && (kAsiceSuccess == state); i++) {
+    if (0 == (address_mask & (1 << i))) {
+      continue;
+    }
+
+    uint16_t data;
+    if ((kAsiceSuccess != asic_chain_set_address(chain, i)) ||
+        (kAsiceSuccess > asic_chain_read_cached(chain, REG_ADC_LOAD_SENSE_CONFIG, &data)) ||
+        ((0 != asics) && (data != timing)) ||
+        (kAsiceSuccess > asic_chain_read_cached(chain, REG_ADC_STATE, &adc_state[asics]))) {
+      state = kAsiceERR;
+      break;
+    }
+
+    timing = data;
+    adc_state[asics] = (adc_state[asics] & ~(CHANNEL_MASK | ADC_EN | kAdcSync)) |
+                       (uint16_t)kADCChannel_LoadSense;
+    addresses[asics] = i;
+    asics++;
+  }
+  asic_chain_set_address(chain, address);
+  if (kAsiceSuccess != state) {
+    return state;
+  }
+
+  /* Same pulse count as asic_chain_adc_load_sense_hold */
+  uint16_t pulse_number = (timing & BYTE_MASK) + ((timing >> 8) & BYTE_MASK) + 3;
+  uint16_t channel = 0;
+  while (0 == (channel_mask & (1 << channel))) {
+    channel++;
+  }
+
+  /* ADC on the load sense input and the first channel selected */
+  uint32_t frames[2 * ASIC_MAX_DEVICES];
+  asic_batch batch;
+  asic_chain_batch_begin(chain, &batch, frames, 2 * ASIC_MAX_DEVICES);
+  for (uint8_t a = 0; a < asics; a++) {
+    asic_batch_write_to(&batch, addresses[a], REG_ADC_STATE, adc_state[a]);
+    asic_batch_write_to(&batch, addresses[a], REG_ADC_LOAD_SENSE, 1 << channel);
+  }
+  state = asic_batch_submit(&batch);
+
+  while ((kAsiceSuccess == state) && (channel < ASIC_LOAD_SENSE_CHANNELS)) {
+    /* Charge and measure on every asic at once, then convert. Completions are ignored from
+     * before the burst until the start has gone out, so a late sync edge can't pass for one. A
+     * conversion that finishes during the start transfer is found by the bus poll fallback. */
+    done_disarm(chain, address_mask);
+    for (uint8_t a = 0; a < asics; a++) {
+      asic_batch_write_to(&batch, addresses[a], REG_ADC_STATE, adc_state[a] | kAdcSync);
+    }
+    state = asic_batch_submit_repeat(&batch, pulse_number);
+    for (uint8_t a = 0; (a < asics) && (kAsiceSuccess == state); a++) {
+      asic_batch_write_to(&batch, addresses[a], REG_ADC_STATE, adc_state[a] | ADC_EN);
+    }
+    if (kAsiceSuccess == state) {
+      state = asic_batch_submit(&batch);
+    }
+    if (kAsiceSuccess == state) {
+      done_arm(chain, address_mask);
+    }
+    for (uint8_t a = 0; (a < asics) && (kAsiceSuccess == state); a++) {
+      if ((kAsiceSuccess != asic_chain_set_address(chain, addresses[a])) ||
+          (kAsiceSuccess != wait_done(chain))) {
+        state = kAsiceERR;
+      }
+    }
+    asic_chain_set_address(chain, address);
+    if (kAsiceSuccess != state) {
+      break;
+    }
+
+    /* Read this channel and move the select to the next one in the same transfer */
+    uint16_t next = channel + 1;
+    while ((next < ASIC_LOAD_SENSE_CHANNELS) && (0 == (channel_mask & (1 << next)))) {
+      next++;
+    }
+    uint16_t select = (next < ASIC_LOAD_SENSE_CHANNELS) ? (uint16_t)(1 << next) : 0;
+    uint32_t rx[2 * ASIC_MAX_DEVICES];
+    for (uint8_t a = 0; a < asics; a++) {
+      frames[a] = asic_frame_encode(addresses[a], REG_ADC_VAL, true, 0);
+      frames[asics + a] = asic_frame_encode(addresses[a], REG_ADC_LOAD_SENSE, false, select);
+    }
+    state = asic_chain_transfer_frames(chain, frames, rx, 2 * asics);
+    for (uint8_t a = 0; (a < asics) && (kAsiceSuccess == state); a++) {
+      map[(addresses[a] * ASIC_LOAD_SENSE_CHANNELS) + channel] = (uint16_t)(rx[a] & 0xFFFF);
+    }
+    channel = next;
+  }
+
+  if (kAsiceSuccess != state) {
+    load_sense_release(chain, address_mask);
+  }
+  return state;
+}
+
 /**
  * @brief Load sense channel
  *
+ * @param chain [in] Asic chain
  * @param channel [in] 0-7 Channel to load
  * @return asicState
  */
-asicState asic_adc_load_sense_sel(ADCChannels channel) {
+asicState asic_chain_adc_load_sense_sel(asic_chain* chain, ADCChannels channel) {
   /*
    * Only one bit must be set at a time to
    * avoid damaging the LOAD_SENSE block
    */
-  return asic_write(REG_ADC_LOAD_SENSE, (1 << (uint16_t)channel));
+  return asic_chain_write(chain, REG_ADC_LOAD_SENSE, (1 << (uint16_t)channel));
+}
+
+/* Default chain */
+
+asicState asic_adc_done_irq_enable(uint8_t gpio_channel) {
+  return asic_chain_adc_done_irq_enable(asic_default_chain(), gpio_channel);
+}
+
+void asic_adc_done_irq_disable(void) {
+  asic_chain_adc_done_irq_disable(asic_default_chain());
+}
+
+void asic_adc_done_isr(uint8_t address) {
+  asic_chain_adc_done_isr(asic_default_chain(), address);
+}
+
+asicState adc_set_clock_divider(uint16_t clock_divider) {
+  return asic_chain_adc_set_clock_divider(asic_default_chain(), clock_divider);
+}
+
+asicState asic_adc_set_load_sense_timing(uint16_t charge_time, uint16_t measure_time) {
+  return asic_chain_adc_set_load_sense_timing(asic_default_chain(), charge_time, measure_time);
+}
+
+asicState asic_adc_set_load_sense_config(uint16_t pF_trim) {
+  return asic_chain_adc_set_load_sense_config(asic_default_chain(), pF_trim);
 }
+
+asicState asic_adc_init(void) {
+  return asic_chain_adc_init(asic_default_chain());
+}
+
+asicState asic_adc_init_broadcast(uint8_t address_mask) {
+  return asic_chain_adc_init_broadcast(asic_default_chain(), address_mask);
+}
+
+asicState asic_adc_start_sample(void) {
+  return asic_chain_adc_start_sample(asic_default_chain());
+}
+
+asicState asic_adc_sync(void) {
+  return asic_chain_adc_sync(asic_default_chain());
+}
+
+asicState asic_adc_set_channel(ADCChannels adc_channel) {
+  return asic_chain_adc_set_channel(asic_default_chain(), adc_channel);
+}
+
+asicState asic_adc_load_sense_hold(void) {
+  return asic_chain_adc_load_sense_hold(asic_default_chain());
+}
+
+bool asic_adc_ready(void) {
+  return asic_chain_adc_ready(asic_default_chain());
+}
+
+asicState asic_adc_get_value(uint16_t* reading) {
+  return asic_chain_adc_get_value(asic_default_chain(), reading);
+}
+
+asicState asic_adc_scan(const ADCChannels* channels, uint8_t channel_count, uint8_t address_mask,
+                        uint16_t* results) {
+  return asic_chain_adc_scan(asic_default_chain(), channels, channel_count, address_mask,
+                             results);
+}
+
+asicState asic_adc_load_sense_map(uint8_t address_mask, uint16_t channel_mask, uint16_t* map) {
+  return asic_chain_adc_load_sense_map(asic_default_chain(), address_mask, channel_mask, map);
+}
+
+asicState asic_adc_load_sense_sel(ADCChannels channel) {
+  return asic_chain_adc_load_sense_sel(asic_default_chain(), channel);
+}
\ No newline at end of file
@@ -0,0 +1,262 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "asic_adc.h"
+#include "asic_adc_stream.h"
+#include "asic_common.h"
+#include "asic_spi.h"
+
+/**
+ * @brief Make a channel sequence odd before its statistics change, producer only
+ *
+ * @param sequence [in/out] Sequence of the channel
+ * @return uint32_t Even value to hand to stats_write_end
+ */
+static uint32_t stats_write_begin(_Atomic uint32_t* sequence) {
+  uint32_t value = atomic_load_explicit(sequence, memory_order_relaxed);
+  atomic_store_explicit(sequence, value + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  return value;
+}
+
+/**
+ * @brief Make a channel sequence even again once its statistics are consistent
+ *
+ * @param sequence [in/out] Sequence of the channel
+ * @param value [in] Returned by stats_write_begin
+ */
+static void stats_write_end(_Atomic uint32_t* sequence, uint32_t value) {
+  atomic_store_explicit(sequence, value + 2, memory_order_release);
+}
+
+/**
+ * @brief Add a reading to the statistics of its channel, producer only
+ *
+ * Each channel has its own sequence, odd while its statistics change, so readers only retry a
+ * torn copy of the channel they read and are not held off by readings of the others.
+ *
+ * @param stream [in/out] Stream handle
+ * @param address [in] Asic address
+ * @param channel [in] ADC channel
+ * @param value [in] Reading
+ */
+static void stream_stats_update(asic_adc_stream* stream, uint8_t address, ADCChannels channel,
+                                uint16_t value) {
+  if (atomic_exchange_explicit(&stream->stats_reset, false, memory_order_acquire)) {
+    for (uint8_t a = 0; a < ASIC_MAX_DEVICES; a++) {
+      for (uint8_t c = 0; c < kADCChannel_Total; c++) {
+        uint32_t sequence = stats_write_begin(&stream->stats_sequence[a][c]);
+        memset(&stream->stats[a][c], 0, sizeof(stream->stats[a][c]));
+        stats_write_end(&stream->stats_sequence[a][c], sequence);
+      }
+    }
+  }
+
+  asic_adc_stats* stats = &stream->stats[address][channel];
+  uint32_t sequence = stats_write_begin(&stream->stats_sequence[address][channel]);
+  if ((0 == stats->count) || (value < stats->min)) {
+    stats->min = value;
+  }
+  if ((0 == stats->count) || (value > stats->max)) {
+    stats->max = value;
+  }
+  stats->count++;
+  stats->sum += value;
+  stats_write_end(&stream->stats_sequence[address][channel], sequence);
+}
+
+/**
+ * @brief Set up an acquisition pipeline on a chain
+ *
+ * @param chain [in] Asic chain
+ * @param stream [out] Stream handle
+ * @param ring [in] Sample storage, must stay valid while the stream is in use
+ * @param size [in] Samples in the ring, a power of two
+ * @param decimation [in] Readings averaged into each stored sample, 1 stores every reading
+ * @return asicState
+ */
+asicState asic_chain_adc_stream_init(asic_chain* chain, asic_adc_stream* stream,
+                                     asic_adc_sample* ring, uint32_t size, uint16_t decimation) {
+  if ((NULL == chain) || (NULL == stream) || (NULL == ring) || (0 == size) ||
+      (0 != (size & (size - 1))) || (0 == decimation)) {
+    return kAsiceERR;
+  }
+
+  memset(stream, 0, sizeof(*stream));
+  stream->chain = chain;
+  stream->ring = ring;
+  stream->mask = size - 1;
+  stream->decimation = decimation;
+  atomic_init(&stream->head, 0);
+  atomic_init(&stream->tail, 0);
+  for (uint8_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    for (uint8_t channel = 0; channel < kADCChannel_Total; channel++) {
+      atomic_init(&stream->stats_sequence[address][channel], 0);
+    }
+  }
+  atomic_init(&stream->stats_reset, false);
+  atomic_init(&stream->overruns, 0);
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Timestamp stored samples
+ *
+ * @param stream [in/out] Stream handle
+ * @param timestamp [in] Free running counter, NULL to store 0
+ */
+void asic_adc_stream_set_clock(asic_adc_stream* stream, uint32_t (*timestamp)(void)) {
+  stream->timestamp = timestamp;
+}
+
+/**
+ * @brief Add one reading, producer only
+ *
+ * Every decimation readings of a channel store one sample with their mean. A sample that finds
+ * the ring full is dropped and counted in overruns, the producer never waits for the consumer.
+ *
+ * @param stream [in/out] Stream handle
+ * @param address [in] Asic address
+ * @param channel [in] ADC channel
+ * @param value [in] Reading
+ */
+void asic_adc_stream_push(asic_adc_stream* stream, uint8_t address, ADCChannels channel,
+                          uint16_t value) {
+  if ((address >= ASIC_MAX_DEVICES) || (channel >= kADCChannel_Total)) {
+    return;
+  }
+
+  stream_stats_update(stream, address, channel, value);
+  stream->pending_sum[address][channel] += value;
+  if (++stream->pending[address][channel] < stream->decimation) {
+    return;
+  }
+
+  uint32_t sum = stream->pending_sum[address][channel];
+  stream->pending_sum[address][channel] = 0;
+  stream->pending[address][channel] = 0;
+  uint32_t head = atomic_load_explicit(&stream->head, memory_order_relaxed);
+  if ((head - atomic_load_explicit(&stream->tail, memory_order_acquire)) > stream->mask) {
+    atomic_fetch_add_explicit(&stream->overruns, 1, memory_order_relaxed);
+    return;
+  }
+
+  asic_adc_sample* sample = &stream->ring[head & stream->mask];
+  sample->time = (NULL != stream->timestamp) ? stream->timestamp() : 0;
+  sample->value = (uint16_t)((sum + (stream->decimation / 2)) / stream->decimation);
+  sample->address = address;
+  sample->channel = (uint8_t)channel;
+  atomic_store_explicit(&stream->head, head + 1, memory_order_release);
+}
+
+/**
+ * @brief Sample a list of channels on a set of asics and push every reading
+ *
+ * Uses asic_chain_adc_scan, so each asic converts while the others are read out.
+ *
+ * @param stream [in/out] Stream handle
+ * @param channels [in] Channels to sample, in order
+ * @param channel_count [in] Number of channels, at most kADCChannel_Total
+ * @param address_mask [in] Bit n set for asic address n
+ * @return asicState
+ */
+asicState asic_adc_stream_acquire(asic_adc_stream* stream, const ADCChannels* channels,
+                                  uint8_t channel_count, uint8_t address_mask) {
+  uint16_t results[kADCChannel_Total * ASIC_MAX_DEVICES];
+  if ((channel_count > kADCChannel_Total) ||
+      (kAsiceSuccess !=
+       asic_chain_adc_scan(stream->chain, channels, channel_count, address_mask, results))) {
+    return kAsiceERR;
+  }
+
+  uint32_t result = 0;
+  for (uint8_t c = 0; c < channel_count; c++) {
+    for (uint8_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+      if (0 != (address_mask & (1 << address))) {
+        asic_adc_stream_push(stream, address, channels[c], results[result++]);
+      }
+    }
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Oldest stored samples, consumer only
+ *
+ * The samples are read in place, nothing is copied. Only the run up to the end of the ring is
+ * returned, the rest follows on the next call after asic_adc_stream_release.
+ *
+ * @param stream [in] Stream handle
+ * @param samples [out] First sample
+ * @return uint32_t samples available at samples
+ */
+uint32_t asic_adc_stream_peek(asic_adc_stream* stream, const asic_adc_sample** samples) {
+  uint32_t tail = atomic_load_explicit(&stream->tail, memory_order_relaxed);
+  uint32_t available = atomic_load_explicit(&stream->head, memory_order_acquire) - tail;
+  uint32_t contiguous = (stream->mask + 1) - (tail & stream->mask);
+  *samples = &stream->ring[tail & stream->mask];
+  return (available < contiguous) ? available : contiguous;
+}
+
+/**
+ * @brief Hand samples returned by asic_adc_stream_peek back to the producer, consumer only
+ *
+ * @param stream [in/out] Stream handle
+ * @param count [in] Samples done with, at most the number peeked
+ */
+void asic_adc_stream_release(asic_adc_stream* stream, uint32_t count) {
+  uint32_t tail = atomic_load_explicit(&stream->tail, memory_order_relaxed);
+  atomic_store_explicit(&stream->tail, tail + count, memory_order_release);
+}
+
+/**
+ * @brief Consistent copy of the statistics of one channel, from any context
+ *
+ * Retries while the producer is updating them, up to ASIC_ADC_STREAM_STATS_RETRIES times. A
+ * reader that preempts the producer mid update can never see it finish, so it gets kAsiceERR and
+ * should try again later rather than loop.
+ *
+ * @param stream [in] Stream handle
+ * @param address [in] Asic address
+ * @param channel [in] ADC channel
+ * @param snapshot [out] Statistics, with the mean filled in
+ * @return asicState
+ */
+asicState asic_adc_stream_stats(asic_adc_stream* stream, uint8_t address, ADCChannels channel,
+                                asic_adc_stats* snapshot) {
+  if ((address >= ASIC_MAX_DEVICES) || (channel >= kADCChannel_Total)) {
+    return kAsiceERR;
+  }
+
+  const asic_adc_stats* stats = &stream->stats[address][channel];
+  _Atomic uint32_t* channel_sequence = &stream->stats_sequence[address][channel];
+  for (uint32_t retry = 0; retry < ASIC_ADC_STREAM_STATS_RETRIES; retry++) {
+    uint32_t sequence = atomic_load_explicit(channel_sequence, memory_order_acquire);
+    *snapshot = *stats;
+    atomic_thread_fence(memory_order_acquire);
+    if ((0 == (sequence & 1)) &&
+        (sequence == atomic_load_explicit(channel_sequence, memory_order_relaxed))) {
+      snapshot->mean = (0 == snapshot->count) ? 0 : (uint16_t)(snapshot->sum / snapshot->count);
+      return kAsiceSuccess;
+    }
+  }
+  return kAsiceERR;
+}
+
+/**
+ * @brief Clear every statistic, takes effect on the next reading pushed
+ *
+ * @param stream [in/out] Stream handle
+ */
+void asic_adc_stream_stats_reset(asic_adc_stream* stream) {
+  atomic_store_explicit(&stream->stats_reset, true, memory_order_release);
+}
+
+/* Default chain */
+
+asicState asic_adc_stream_init(asic_adc_stream* stream, asic_adc_sample* ring, uint32_t size,
+                               uint16_t decimation) {
+  return asic_chain_adc_stream_init(asic_default_chain(), stream, ring, size, decimation);
+}
@@ -0,0 +1,265 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "asic_common.h"
+#include "asic_focus.h"
+#include "asic_pwm.h"
+#include "asic_pwm_stream.h"
+
+/* atan(2^-i) in 1/65536 turns */
+static const int32_t kCordicAtan[] = {8192, 4836, 2555, 1297, 651, 326, 163, 81,
+                                      41,   20,   10,   5,    3,   1,   1,   0};
+/* 1 / CORDIC gain in Q15 */
+static const int64_t kCordicScale = 19898;
+
+/**
+ * @brief Integer square root, rounded down
+ *
+ * @param value [in] Value
+ * @return uint32_t root
+ */
+static uint32_t focus_sqrt(uint64_t value) {
+  uint64_t root = 0;
+  uint64_t bit = 1ULL << 62;
+  while (bit > value) {
+    bit >>= 2;
+  }
+  while (0 != bit) {
+    if (value >= (root + bit)) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)root;
+}
+
+/**
+ * @brief Rotate an amplitude to a phase, giving its real and imaginary parts
+ *
+ * @param amplitude [in] Length of the vector
+ * @param phase [in] Angle in 1/65536 turns
+ * @param re [out] Real part
+ * @param im [out] Imaginary part
+ */
+static void focus_rotate(uint16_t amplitude, uint16_t phase, int32_t* re, int32_t* im) {
+  int32_t x = (int32_t)((amplitude * kCordicScale) >> 15);
+  int32_t y = 0;
+  int32_t angle = (int16_t)phase;
+  /* CORDIC converges within a quarter turn, start from the opposite vector otherwise */
+  if ((angle > 16384) || (angle < -16384)) {
+    x = -x;
+    angle += (angle > 0) ? -32768 : 32768;
+  }
+  for (uint32_t i = 0; i < (sizeof(kCordicAtan) / sizeof(kCordicAtan[0])); i++) {
+    int32_t dx = y >> i;
+    int32_t dy = x >> i;
+    if (angle >= 0) {
+      x -= dx;
+      y += dy;
+      angle -= kCordicAtan[i];
+    } else {
+      x += dx;
+      y -= dy;
+      angle += kCordicAtan[i];
+    }
+  }
+  *re = x;
+  *im = y;
+}
+
+/**
+ * @brief Phase and length of a vector
+ *
+ * @param re [in] Real part
+ * @param im [in] Imaginary part
+ * @param magnitude [out] Length of the vector
+ * @return uint16_t angle in 1/65536 turns
+ */
+static uint16_t focus_vector(int32_t re, int32_t im, uint32_t* magnitude) {
+  int32_t x = re;
+  int32_t y = im;
+  int32_t angle = 0;
+  if (x < 0) {
+    x = -x;
+    y = -y;
+    angle = 32768;
+  }
+  for (uint32_t i = 0; i < (sizeof(kCordicAtan) / sizeof(kCordicAtan[0])); i++) {
+    int32_t dx = y >> i;
+    int32_t dy = x >> i;
+    if (y > 0) {
+      x += dx;
+      y -= dy;
+      angle += kCordicAtan[i];
+    } else {
+      x -= dx;
+      y += dy;
+      angle -= kCordicAtan[i];
+    }
+  }
+  *magnitude = (uint32_t)((x * kCordicScale) >> 15);
+  return (uint16_t)angle;
+}
+
+/**
+ * @brief Phase of a focal point's wave at each transducer of one asic
+ *
+ * The distances are computed for all channels first, that loop has no dependencies between
+ * channels and vectorises over the position arrays.
+ *
+ * @param focus [in] Focus handle
+ * @param address [in] Asic address
+ * @param point [in] Focal point
+ * @param phase [out] ASIC_PWM_CHANNELS phases in 1/65536 turns
+ */
+static void focus_phase(const asic_focus* focus, uint32_t address, const asic_focus_point* point,
+                        uint16_t* phase) {
+  const asic_focus_geometry* geometry = focus->geometry;
+  const int32_t* x = &geometry->x[address * ASIC_PWM_CHANNELS];
+  const int32_t* y = &geometry->y[address * ASIC_PWM_CHANNELS];
+  const int32_t* z = &geometry->z[address * ASIC_PWM_CHANNELS];
+  uint64_t squared[ASIC_PWM_CHANNELS];
+  for (uint16_t channel = 0; channel < ASIC_PWM_CHANNELS; channel++) {
+    int64_t dx = (int64_t)x[channel] - point->x;
+    int64_t dy = (int64_t)y[channel] - point->y;
+    int64_t dz = (int64_t)z[channel] - point->z;
+    squared[channel] = (uint64_t)((dx * dx) + (dy * dy) + (dz * dz));
+  }
+  for (uint16_t channel = 0; channel < ASIC_PWM_CHANNELS; channel++) {
+    /* Whole wavelengths land above bit 15 and drop out */
+    phase[channel] = (uint16_t)((focus_sqrt(squared[channel]) * focus->turns) >> 32);
+  }
+}
+
+/**
+ * @brief Delay that brings a phase back to zero at the focal point
+ *
+ * @param focus [in] Focus handle
+ * @param phase [in] Phase of the wave at the transducer in 1/65536 turns
+ * @return uint16_t delay in PWM clocks
+ */
+static uint16_t focus_delay(const asic_focus* focus, uint16_t phase) {
+  uint32_t advance = (uint16_t)(0 - phase);
+  uint32_t delay = ((advance * focus->period) + 0x8000) >> 16;
+  return (delay < focus->period) ? (uint16_t)delay : 0;
+}
+
+/**
+ * @brief Duty of an amplitude, full amplitude is half the period
+ *
+ * @param focus [in] Focus handle
+ * @param amplitude [in] 0 - ASIC_FOCUS_AMPLITUDE_MAX
+ * @return uint16_t duty in PWM clocks
+ */
+static uint16_t focus_duty(const asic_focus* focus, uint32_t amplitude) {
+  return (uint16_t)(((amplitude * focus->period) + 0x10000) >> 17);
+}
+
+/**
+ * @brief Set up the computation for a chain
+ *
+ * @param focus [out] Focus handle
+ * @param geometry [in] Transducer positions, must stay valid while the handle is used
+ * @param address_mask [in] Bit n set to compute asic address n
+ * @param pwm_clock [in] Hz, PWM counter clock
+ * @param frequency [in] Hz, carrier frequency
+ * @param speed_of_sound [in] mm/s, e.g. 343000 in air at 20 C
+ * @return asicState
+ */
+asicState asic_focus_init(asic_focus* focus, const asic_focus_geometry* geometry,
+                          uint8_t address_mask, uint32_t pwm_clock, uint32_t frequency,
+                          uint32_t speed_of_sound) {
+  if ((NULL == focus) || (NULL == geometry) || (0 == address_mask) || (0 == frequency)) {
+    return kAsiceERR;
+  }
+
+  uint32_t period = pwm_clock / frequency;
+  uint64_t wavelength = ((uint64_t)speed_of_sound * 1000) / frequency;
+  if ((0 == period) || (period > UINT16_MAX) || (0 == wavelength) ||
+      (wavelength > UINT32_MAX)) {
+    return kAsiceERR;
+  }
+
+  memset(focus, 0, sizeof(*focus));
+  focus->geometry = geometry;
+  focus->address_mask = address_mask;
+  focus->period = (uint16_t)period;
+  focus->wavelength = (uint32_t)wavelength;
+  focus->turns = ((1ULL << 48) + wavelength - 1) / wavelength;
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Compute the duty and delay of every transducer for a set of focal points
+ *
+ * Each transducer is driven with the sum of the waves that arrive in phase at every point, its
+ * delay is the phase of the sum and its duty the length of the sum. Points whose amplitudes add
+ * up to more than ASIC_FOCUS_AMPLITUDE_MAX are scaled down together so the sum fits, otherwise
+ * the duty matches a single point of the same amplitude. A single point skips the sum and
+ * drives every transducer at the point's amplitude.
+ *
+ * @param focus [in] Focus handle
+ * @param points [in] Focal points
+ * @param count [in] 1 - ASIC_FOCUS_MAX_POINTS points
+ * @param frame [out] Frame for asic_pwm_stream or asic_pwm_set_frame
+ * @return asicState
+ */
+asicState asic_focus_compute(const asic_focus* focus, const asic_focus_point* points,
+                             uint16_t count, asic_pwm_frame* frame) {
+  if ((NULL == points) || (NULL == frame) || (0 == count) || (count > ASIC_FOCUS_MAX_POINTS)) {
+    return kAsiceERR;
+  }
+
+  uint32_t total = 0;
+  for (uint16_t point = 0; point < count; point++) {
+    total += points[point].amplitude;
+  }
+  uint32_t scale = (total > ASIC_FOCUS_AMPLITUDE_MAX) ? total : ASIC_FOCUS_AMPLITUDE_MAX;
+
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if (0 == (focus->address_mask & (1 << address))) {
+      continue;
+    }
+
+    uint16_t* duty = frame->duty[address];
+    uint16_t* delay = frame->delay[address];
+    uint16_t phase[ASIC_PWM_CHANNELS];
+    if (1 == count) {
+      focus_phase(focus, address, &points[0], phase);
+      for (uint16_t channel = 0; channel < ASIC_PWM_CHANNELS; channel++) {
+        delay[channel] = focus_delay(focus, phase[channel]);
+        duty[channel] = focus_duty(focus, points[0].amplitude);
+      }
+      continue;
+    }
+
+    int32_t re[ASIC_PWM_CHANNELS] = {0};
+    int32_t im[ASIC_PWM_CHANNELS] = {0};
+    for (uint16_t point = 0; point < count; point++) {
+      focus_phase(focus, address, &points[point], phase);
+      for (uint16_t channel = 0; channel < ASIC_PWM_CHANNELS; channel++) {
+        int32_t x;
+        int32_t y;
+        focus_rotate(points[point].amplitude, phase[channel], &x, &y);
+        re[channel] += x;
+        im[channel] += y;
+      }
+    }
+    for (uint16_t channel = 0; channel < ASIC_PWM_CHANNELS; channel++) {
+      uint32_t magnitude;
+      uint16_t sum = focus_vector(re[channel], im[channel], &magnitude);
+      uint32_t amplitude = (uint32_t)(((uint64_t)magnitude * ASIC_FOCUS_AMPLITUDE_MAX) / scale);
+      if (amplitude > ASIC_FOCUS_AMPLITUDE_MAX) {
+        /* CORDIC rounding of points in phase */
+        amplitude = ASIC_FOCUS_AMPLITUDE_MAX;
+      }
+      delay[channel] = focus_delay(focus, sum);
+      duty[channel] = focus_duty(focus, amplitude);
+    }
+  }
+  return kAsiceSuccess;
+}
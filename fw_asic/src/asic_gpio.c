@@ -8,21 +8,24 @@
 /**
  * @brief Enable Asics GPIO outputs
  *
+ * @param chain [in] Asic chain
  * @param gpio_bit_mask [in] (4 bits) Can be made from ORing GpioChanReg enums
  * @return asicState
  */
-asicState asic_gpio_output_enable(uint16_t gpio_bit_mask) {
-  return asic_write(REG_GPIO_OE, gpio_bit_mask);
+asicState asic_chain_gpio_output_enable(asic_chain* chain, uint16_t gpio_bit_mask) {
+  return asic_chain_write(chain, REG_GPIO_OE, gpio_bit_mask);
 }
 
 /**
  * @brief Select what the GPIO output represents
  *
+ * @param chain [in] Asic chain
  * @param gpio_channel [in] 0 - 3 GPIO channel
  * @param outsel [in] Output selection
  * @return asicState
  */
-asicState asic_gpio_output_select(uint8_t gpio_channel, GpioOutSel outsel) {
+asicState asic_chain_gpio_output_select(asic_chain* chain, uint8_t gpio_channel,
+                                        GpioOutSel outsel) {
   if (gpio_channel > 3) {
     return kAsiceERR;
   }
@@ -30,61 +33,182 @@ asicState asic_gpio_output_select(uint8_t gpio_channel, GpioOutSel outsel) {
   uint16_t gpio_channel_mask = (uint16_t)0xf << (4 * gpio_channel);
   uint16_t shifted_outsel = ((uint16_t)outsel & 0xf) << (4 * gpio_channel);
   uint16_t data;
-  asicState state = asic_read(REG_GPIO_OUTSEL, &data);
+  asicState state = asic_chain_read_cached(chain, REG_GPIO_OUTSEL, &data);
   if (kAsiceSuccess > state) {
     return state;
   }
 
   data &= ~gpio_channel_mask;
   data |= shifted_outsel;
-  return asic_write(REG_GPIO_OUTSEL, data);
+  return asic_chain_write(chain, REG_GPIO_OUTSEL, data);
+}
+
+/**
+ * @brief Current value of a register on every asic in a mask
+ *
+ * Taken from the register shadow where it is known, the rest are read in one transfer.
+ *
+ * @param chain [in] Asic chain
+ * @param address_mask [in] Bit n set for asic address n
+ * @param reg [in] Asic register
+ * @param data [out] ASIC_MAX_DEVICES values indexed by address
+ * @return asicState
+ */
+static asicState gpio_read_each(asic_chain* chain, uint8_t address_mask, asicReg reg,
+                                uint16_t* data) {
+  uint8_t unknown = 0;
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if ((0 != (address_mask & (1 << address))) &&
+        !asic_chain_shadow_get(chain, address, reg, &data[address])) {
+      unknown |= (uint8_t)(1 << address);
+    }
+  }
+  return (0 == unknown) ? kAsiceSuccess : asic_chain_read_each(chain, unknown, reg, data);
+}
+
+/**
+ * @brief Select what a GPIO output represents and enable it, on every asic in a mask
+ *
+ * Each asic keeps its own selection and enable of the other GPIOs, so it works whether or not
+ * the asics agree. The writes go out as one batch.
+ *
+ * @param chain [in] Asic chain
+ * @param address_mask [in] Bit n set for asic address n
+ * @param gpio_channel [in] 0 - 3 GPIO channel
+ * @param outsel [in] Output selection
+ * @return asicState
+ */
+asicState asic_chain_gpio_route(asic_chain* chain, uint8_t address_mask, uint8_t gpio_channel,
+                                GpioOutSel outsel) {
+  uint16_t select[ASIC_MAX_DEVICES];
+  uint16_t enable[ASIC_MAX_DEVICES];
+  if ((gpio_channel > 3) || (0 == address_mask) ||
+      (kAsiceSuccess != gpio_read_each(chain, address_mask, REG_GPIO_OUTSEL, select)) ||
+      (kAsiceSuccess != gpio_read_each(chain, address_mask, REG_GPIO_OE, enable))) {
+    return kAsiceERR;
+  }
+
+  uint16_t gpio_channel_mask = (uint16_t)0xf << (4 * gpio_channel);
+  uint16_t shifted_outsel = ((uint16_t)outsel & 0xf) << (4 * gpio_channel);
+  uint32_t frames[2 * ASIC_MAX_DEVICES];
+  asic_batch batch;
+  if (kAsiceSuccess != asic_chain_batch_begin(chain, &batch, frames, 2 * ASIC_MAX_DEVICES)) {
+    return kAsiceERR;
+  }
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if (0 == (address_mask & (1 << address))) {
+      continue;
+    }
+    uint16_t data = (select[address] & ~gpio_channel_mask) | shifted_outsel;
+    if ((kAsiceSuccess != asic_batch_write_to(&batch, address, REG_GPIO_OUTSEL, data)) ||
+        (kAsiceSuccess != asic_batch_write_to(&batch, address, REG_GPIO_OE,
+                                              enable[address] | (1 << gpio_channel)))) {
+      return kAsiceERR;
+    }
+  }
+  return asic_batch_submit(&batch);
 }
 
 /**
  * @brief State of outputs (only when outsel is GPIO (0))
  *
+ * @param chain [in] Asic chain
  * @param gpio_chan_reg [in] Output values (Can be made from ORing GpioChanReg)
  * @return asicState
  */
-asicState asic_gpio_write(uint16_t gpio_chan_reg) {
-  return asic_write(REG_GPIO_OUT, gpio_chan_reg);
+asicState asic_chain_gpio_write(asic_chain* chain, uint16_t gpio_chan_reg) {
+  return asic_chain_write(chain, REG_GPIO_OUT, gpio_chan_reg);
 }
 
-void asic_gpio_init(void) {
-  asic_gpio_write(kGPIO_None);
-  for (uint8_t gpio = 0; gpio < 4; gpio++) {
-    asic_gpio_output_select(gpio, kGPIOOutsel_GPIO);
+void asic_chain_gpio_init(asic_chain* chain) {
+  /* All outputs low, driven as plain GPIO (kGPIOOutsel_GPIO in every nibble) */
+  static const asic_reg_write kGpioInitTable[] = {
+      {REG_GPIO_OUT, kGPIO_None},
+      {REG_GPIO_OUTSEL, 0x0000},
+      {REG_GPIO_OE, kGPIO_All},
+  };
+  asic_chain_write_table(chain, kGpioInitTable,
+                         sizeof(kGpioInitTable) / sizeof(kGpioInitTable[0]), false);
+}
+
+/**
+ * @brief Initialise the GPIO of every asic in the mask at once
+ *
+ * @param chain [in] Asic chain
+ * @param address_mask [in] Bit n set for asic address n
+ */
+void asic_chain_gpio_init_broadcast(asic_chain* chain, uint8_t address_mask) {
+  if (kAsiceSuccess != asic_chain_broadcast_begin(chain, address_mask)) {
+    return;
   }
-  asic_gpio_output_enable(kGPIO_All);
+
+  asic_chain_gpio_init(chain);
+  asic_chain_broadcast_end(chain);
 }
 
 /**
  * @brief Read GPIO states
  *
+ * @param chain [in] Asic chain
  * @param data [in/out] GPIO states pointer
  * @return asicState
  */
-asicState asic_gpio_read(uint16_t* data) {
-  return asic_read(REG_GPIO_IN, data);
+asicState asic_chain_gpio_read(asic_chain* chain, uint16_t* data) {
+  return asic_chain_read(chain, REG_GPIO_IN, data);
 }
 
 /**
  * @brief Configure pwm channel on output (only when outsel is PWM_GPIOx)
  *
+ * @param chain [in] Asic chain
  * @param gpio_channel [in] 0 - 3 GPIO Channel
  * @param channel [in] 0 - 15 PWM Channel
  * @return asicState
  */
-asicState asic_pwm_mux_select(uint8_t gpio_channel, uint16_t channel) {
+asicState asic_chain_pwm_mux_select(asic_chain* chain, uint8_t gpio_channel, uint16_t channel) {
   uint16_t gpio_channel_mask = (uint16_t)0xf << (4 * gpio_channel);
   uint16_t shifted_mux_sel = ((uint16_t)channel & 0xf) << (4 * gpio_channel);
   uint16_t data;
-  asicState state = asic_read(REG_PWM_GPIO_OUTSEL, &data);
+  asicState state = asic_chain_read_cached(chain, REG_PWM_GPIO_OUTSEL, &data);
   if (kAsiceSuccess > state) {
     return state;
   }
 
   data &= ~gpio_channel_mask;
   data |= shifted_mux_sel;
-  return asic_write(REG_PWM_GPIO_OUTSEL, data);
+  return asic_chain_write(chain, REG_PWM_GPIO_OUTSEL, data);
+}
+
+/* Default chain */
+
+asicState asic_gpio_output_enable(uint16_t gpio_bit_mask) {
+  return asic_chain_gpio_output_enable(asic_default_chain(), gpio_bit_mask);
+}
+
+asicState asic_gpio_output_select(uint8_t gpio_channel, GpioOutSel outsel) {
+  return asic_chain_gpio_output_select(asic_default_chain(), gpio_channel, outsel);
+}
+
+asicState asic_gpio_route(uint8_t address_mask, uint8_t gpio_channel, GpioOutSel outsel) {
+  return asic_chain_gpio_route(asic_default_chain(), address_mask, gpio_channel, outsel);
+}
+
+asicState asic_gpio_write(uint16_t gpio_chan_reg) {
+  return asic_chain_gpio_write(asic_default_chain(), gpio_chan_reg);
+}
+
+void asic_gpio_init(void) {
+  asic_chain_gpio_init(asic_default_chain());
+}
+
+void asic_gpio_init_broadcast(uint8_t address_mask) {
+  asic_chain_gpio_init_broadcast(asic_default_chain(), address_mask);
+}
+
+asicState asic_gpio_read(uint16_t* data) {
+  return asic_chain_gpio_read(asic_default_chain(), data);
+}
+
+asicState asic_pwm_mux_select(uint8_t gpio_channel, uint16_t channel) {
+  return asic_chain_pwm_mux_select(asic_default_chain(), gpio_channel, channel);
 }
\ No newline at end of file
@@ -0,0 +1,188 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "asic_common.h"
+#include "asic_gpio.h"
+#include "asic_link.h"
+#include "asic_regs.h"
+#include "asic_spi.h"
+
+/* Alternating, all ones/zeros and mixed nibbles */
+static const uint16_t kLinkPatterns[] = {0xAAAA, 0x5555, 0xFFFF, 0x0000, 0xA5C3, 0x3C5A};
+
+/**
+ * @brief Sample the CRC error pin
+ *
+ * @param link [in] Link handle
+ * @return true CRC error reported
+ * @return false no error, or no pin
+ */
+static bool link_crc_error(const asic_link* link) {
+  return (NULL != link->config.crc_error) && link->config.crc_error();
+}
+
+/**
+ * @brief Write and read back every pattern on every asic at the current clock
+ *
+ * @param link [in] Link handle
+ * @return true all patterns read back and no CRC error
+ * @return false link unreliable
+ */
+static bool link_test(const asic_link* link) {
+  asic_chain* chain = link->chain;
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if (0 == (link->config.address_mask & (1 << address))) {
+      continue;
+    }
+
+    asic_chain_set_address(chain, address);
+    for (uint32_t i = 0; i < (sizeof(kLinkPatterns) / sizeof(kLinkPatterns[0])); i++) {
+      uint16_t data;
+      if ((kAsiceSuccess != asic_chain_write(chain, link->config.test_reg, kLinkPatterns[i])) ||
+          (kAsiceSuccess != asic_chain_read(chain, link->config.test_reg, &data)) ||
+          (kLinkPatterns[i] != data)) {
+        return false;
+      }
+    }
+  }
+  return !link_crc_error(link);
+}
+
+/**
+ * @brief Route the CRC error flag of every checked asic to its GPIO
+ *
+ * @param link [in] Link handle
+ * @return asicState
+ */
+static asicState link_route_crc(const asic_link* link) {
+  int8_t gpio = link->config.crc_gpio;
+  if (0 > gpio) {
+    return kAsiceSuccess;
+  }
+
+  return asic_chain_gpio_route(link->chain, link->config.address_mask, (uint8_t)gpio,
+                               kGPIOOutsel_CRCError);
+}
+
+/**
+ * @brief Train the link with retransmission disabled
+ *
+ * @param chain [in] Asic chain
+ * @param link [out] Link handle
+ * @param config [in] Training settings, already checked
+ * @return asicState
+ */
+static asicState link_train(asic_chain* chain, asic_link* link, const asic_link_config* config) {
+  link->chain = chain;
+  link->config = *config;
+  link->fastest = 0;
+  link->step_downs = 0;
+
+  uint32_t address = chain->address;
+  uint16_t saved[ASIC_MAX_DEVICES] = {0};
+  if ((kAsiceSuccess != asic_chain_set_speed(chain, config->min_speed)) ||
+      (kAsiceSuccess != link_route_crc(link))) {
+    return kAsiceERR;
+  }
+  for (uint32_t i = 0; i < ASIC_MAX_DEVICES; i++) {
+    if ((0 != (config->address_mask & (1 << i))) &&
+        ((kAsiceSuccess != asic_chain_set_address(chain, i)) ||
+         (kAsiceSuccess != asic_chain_read(chain, config->test_reg, &saved[i])))) {
+      asic_chain_set_address(chain, address);
+      return kAsiceERR;
+    }
+  }
+
+  uint32_t speed = config->min_speed;
+  while ((kAsiceSuccess == asic_chain_set_speed(chain, speed)) && link_test(link)) {
+    link->fastest = speed;
+    if ((config->max_speed - speed) < config->step) {
+      break;
+    }
+    speed += config->step;
+  }
+
+  speed = link->fastest - (uint32_t)(((uint64_t)link->fastest * config->margin) / 100);
+  if (speed < config->min_speed) {
+    speed = config->min_speed;
+  }
+
+  asicState state = asic_chain_set_speed(chain, speed);
+  for (uint32_t i = 0; i < ASIC_MAX_DEVICES; i++) {
+    if ((0 != (config->address_mask & (1 << i))) &&
+        ((kAsiceSuccess != asic_chain_set_address(chain, i)) ||
+         (kAsiceSuccess != asic_chain_write(chain, config->test_reg, saved[i])))) {
+      state = kAsiceERR;
+    }
+  }
+  asic_chain_set_address(chain, address);
+  return (0 != link->fastest) ? state : kAsiceERR;
+}
+
+/**
+ * @brief Find the fastest reliable SPI clock of a chain
+ *
+ * Steps the clock up from min_speed until a write/readback of the test patterns fails or the
+ * CRC error pin is raised, then settles margin percent below the fastest clock that passed.
+ * Run it before the asics are configured: frames at a failing clock may land anywhere.
+ * Retransmission is suspended while training so it can't hide a failing clock.
+ *
+ * @param chain [in] Asic chain
+ * @param link [out] Link handle, used for runtime step down
+ * @param config [in] Training settings
+ * @return asicState error if not even min_speed is reliable (the chain is left at min_speed)
+ */
+asicState asic_chain_link_train(asic_chain* chain, asic_link* link,
+                                const asic_link_config* config) {
+  if ((NULL == link) || (NULL == config) || (0 == config->min_speed) ||
+      (config->min_speed > config->max_speed) || (0 == config->step) ||
+      (0 == config->address_mask) || (100 <= config->margin)) {
+    return kAsiceERR;
+  }
+
+  uint8_t retries = chain->retries;
+  chain->retries = 0;
+  asicState state = link_train(chain, link, config);
+  chain->retries = retries;
+  return state;
+}
+
+/**
+ * @brief Lower the SPI clock by one training step
+ *
+ * @param link [in/out] Link handle
+ * @return asicState error if already at min_speed
+ */
+asicState asic_link_step_down(asic_link* link) {
+  asic_chain* chain = link->chain;
+  uint32_t step = link->config.step;
+  if ((chain->speed <= link->config.min_speed) ||
+      ((chain->speed - link->config.min_speed) < step)) {
+    return kAsiceERR;
+  }
+
+  asicState state = asic_chain_set_speed(chain, chain->speed - step);
+  if (kAsiceSuccess == state) {
+    link->step_downs++;
+  }
+  return state;
+}
+
+/**
+ * @brief Step the clock down if the CRC error pin is raised, call periodically from a task
+ *
+ * @param link [in/out] Link handle
+ * @return asicState error if a CRC error could not be handled
+ */
+asicState asic_link_check(asic_link* link) {
+  if (!link_crc_error(link)) {
+    return kAsiceSuccess;
+  }
+  return asic_link_step_down(link);
+}
+
+/* Default chain */
+
+asicState asic_link_train(asic_link* link, const asic_link_config* config) {
+  return asic_chain_link_train(asic_default_chain(), link, config);
+}
@@ -6,72 +6,113 @@
 #include "asic_regs.h"
 #include "asic_spi.h"
 
+/**
+ * @brief REG_SHORT_CONFIG value
+ *
+ * @param enable [in] Disable hi-z of transducers when short is detected
+ * @param sc_filter [in] Number of PWM clocks to trigger after
+ * @return uint16_t
+ */
+static uint16_t short_config(bool enable, uint16_t sc_filter) {
+  static const uint16_t DISABLE_SC_PROTECTION = 1 << 6;
+  static const uint16_t sc_mask = 0x003F;
+  uint16_t data = (enable ? 0x0000 : DISABLE_SC_PROTECTION);
+  data |= (sc_filter & sc_mask);
+  return data;
+}
+
+/**
+ * @brief REG_PWM_CONFIG value, without the sync bit
+ *
+ * @param enable_linear_mode [in] Enable linear mode
+ * @param enable_count_from_centre [in] Enable count from centre
+ * @return uint16_t
+ */
+static uint16_t pwm_config(bool enable_linear_mode, bool enable_count_from_centre) {
+  static const uint16_t DITHER_SEED_COMMIT = 1 << 11;
+  static const uint16_t LINEAR_MODE_DISABLE = 1 << 14;
+  static const uint16_t COUNT_FROM_CENTRE_ENABLE = 1 << 12;
+  static const uint16_t DITHER_SEED_UPPER = 0x00A9;
+  static const uint16_t DITHER_SEED_LOWER = 0x0001;
+  uint16_t data = DITHER_SEED_COMMIT | (DITHER_SEED_UPPER << 2) | DITHER_SEED_LOWER;
+
+  if (!enable_linear_mode) {
+    data |= LINEAR_MODE_DISABLE;
+  }
+
+  if (enable_count_from_centre) {
+    data |= COUNT_FROM_CENTRE_ENABLE;
+  }
+  return data;
+}
+
 /**
  * @brief Force PWM sync signal high
  *
+ * @param chain [in] Asic chain
  * @return asicState
  */
-asicState asic_pwm_sync(void) {
-  static const uint16_t asic_pwm_sync = 1 << 15;
+asicState asic_chain_pwm_sync(asic_chain* chain) {
   uint16_t data;
-  asicState state = asic_read(REG_PWM_CONFIG, &data);
+  asicState state = asic_chain_read_cached(chain, REG_PWM_CONFIG, &data);
   if (kAsiceSuccess > state) {
     return state;
   }
 
-  data |= asic_pwm_sync;
-  return asic_write(REG_PWM_CONFIG, data);
+  data |= ASIC_PWM_SYNC;
+  return asic_chain_write(chain, REG_PWM_CONFIG, data);
 }
 
 /**
  * @brief Configure short detection
  *
+ * @param chain [in] Asic chain
  * @param enable [in] Disable hi-z of transducers when short is detected
  * @param sc_filter [in] Number of PWM clocks to trigger after
  * @return asicState
  */
-asicState asic_pwm_short_circuit_protection_control(bool enable, uint16_t sc_filter) {
-  static const uint16_t DISABLE_SC_PROTECTION = 1 << 6;
-  static const uint16_t sc_mask = 0x003F;
-  uint16_t data = (enable ? 0x0000 : DISABLE_SC_PROTECTION);
-  data |= (sc_filter & sc_mask);
-  return asic_write(REG_SHORT_CONFIG, data);
+asicState asic_chain_pwm_short_circuit_protection_control(asic_chain* chain, bool enable,
+                                                          uint16_t sc_filter) {
+  return asic_chain_write(chain, REG_SHORT_CONFIG, short_config(enable, sc_filter));
 }
 
 /**
  * @brief Clear short circuit flag
  *
+ * @param chain [in] Asic chain
  * @return asicState
  */
-asicState asic_pwm_short_circuit_clear(void) {
+asicState asic_chain_pwm_short_circuit_clear(asic_chain* chain) {
   static const uint16_t CLEAR_SHORTS = 0xFFFF;
-  return asic_write(REG_SHORT_DETECT, CLEAR_SHORTS);
+  return asic_chain_write(chain, REG_SHORT_DETECT, CLEAR_SHORTS);
 }
 
 /**
  * @brief Get short detections
  *
+ * @param chain [in] Asic chain
  * @param shorts [in/out] Pointer to shorts reading
  * @return asicState
  */
-asicState asic_pwm_short_circuit_get(uint16_t* shorts) {
-  return asic_read(REG_SHORT_DETECT, shorts);
+asicState asic_chain_pwm_short_circuit_get(asic_chain* chain, uint16_t* shorts) {
+  return asic_chain_read(chain, REG_SHORT_DETECT, shorts);
 }
 
 /**
  * @brief Set delay on PWM channel
  *
+ * @param chain [in] Asic chain
  * @param delay [in] Delay value
  * @param channel [in] PWM channel
  * @param sync [in] Force PWM sync high after writing
  * @return asicState
  */
-asicState asic_pwm_delay_set(uint16_t delay, uint16_t channel, bool sync) {
+asicState asic_chain_pwm_delay_set(asic_chain* chain, uint16_t delay, uint16_t channel, bool sync) {
   uint16_t address = REG_PWM0_DELAY + (channel * 2);
-  asicState state = asic_write(address, delay);
+  asicState state = asic_chain_write(chain, address, delay);
 
   if (sync) {
-    asic_pwm_sync();
+    asic_chain_pwm_sync(chain);
   }
   return state;
 }
@@ -79,31 +120,83 @@ asicState asic_pwm_delay_set(uint16_t delay, uint16_t channel, bool sync) {
 /**
  * @brief Set duty on PWM channel
  *
+ * @param chain [in] Asic chain
  * @param duty [in] Duty value
  * @param channel [in] PWM channel
  * @param sync [in] Force PWM sync high after writing
  * @return asicState
  */
-asicState asic_pwm_duty_set(uint16_t duty, uint16_t channel, bool sync) {
+asicState asic_chain_pwm_duty_set(asic_chain* chain, uint16_t duty, uint16_t channel, bool sync) {
   uint16_t address = REG_PWM0_DUTY + (channel * 2);
-  asicState state = asic_write(address, duty);
+  asicState state = asic_chain_write(chain, address, duty);
 
   if (sync) {
-    asic_pwm_sync();
+    asic_chain_pwm_sync(chain);
   }
   return state;
 }
 
+/**
+ * @brief Set duty and delay of several PWM channels followed by one sync
+ *
+ * All writes and the sync are sent as a single batch.
+ *
+ * @param chain [in] Asic chain
+ * @param duty [in] ASIC_PWM_CHANNELS duty values, NULL to leave duty unchanged
+ * @param delay [in] ASIC_PWM_CHANNELS delay values, NULL to leave delay unchanged
+ * @param channel_mask [in] Bit n set to update PWM channel n
+ * @return asicState
+ */
+asicState asic_chain_pwm_set_frame(asic_chain* chain, const uint16_t* duty, const uint16_t* delay,
+                                   uint16_t channel_mask) {
+  uint32_t frames[(2 * ASIC_PWM_CHANNELS) + 1];
+  asic_batch batch;
+  asicState state = asic_chain_batch_begin(chain, &batch, frames,
+                                           sizeof(frames) / sizeof(frames[0]));
+  if (kAsiceSuccess != state) {
+    return state;
+  }
+
+  for (uint16_t channel = 0; channel < ASIC_PWM_CHANNELS; channel++) {
+    if (0 == (channel_mask & (1 << channel))) {
+      continue;
+    }
+
+    uint16_t offset = channel * 2;
+    if ((NULL != duty) &&
+        (kAsiceSuccess != asic_batch_write(&batch, REG_PWM0_DUTY + offset, duty[channel]))) {
+      return kAsiceERR;
+    }
+    if ((NULL != delay) &&
+        (kAsiceSuccess != asic_batch_write(&batch, REG_PWM0_DELAY + offset, delay[channel]))) {
+      return kAsiceERR;
+    }
+  }
+
+  uint16_t data;
+  state = asic_chain_read_cached(chain, REG_PWM_CONFIG, &data);
+  if (kAsiceSuccess > state) {
+    return state;
+  }
+
+  state = asic_batch_write(&batch, REG_PWM_CONFIG, data | ASIC_PWM_SYNC);
+  if (kAsiceSuccess != state) {
+    return state;
+  }
+  return asic_batch_submit(&batch);
+}
+
 /**
  * @brief Set hi-z state on all channels
  *
+ * @param chain [in] Asic chain
  * @param enable_highz [in] Set or clear hi-z
  * @return asicState
  */
-asicState asic_pwm_set_highz(bool enable_highz) {
+asicState asic_chain_pwm_set_highz(asic_chain* chain, bool enable_highz) {
   uint16_t highz_state = (enable_highz ? 0x0000 : 0xFFFF);
-  asicState state = asic_write(REG_PWM_OE, highz_state);
-  asic_pwm_sync();
+  asicState state = asic_chain_write(chain, REG_PWM_OE, highz_state);
+  asic_chain_pwm_sync(chain);
 
   return state;
 }
@@ -111,13 +204,14 @@ asicState asic_pwm_set_highz(bool enable_highz) {
 /**
  * @brief Set PWM state on all channels
  *
+ * @param chain [in] Asic chain
  * @param enable_PWM [in] Enable PWM state
  * @return asicState
  */
-asicState asic_pwm_enable(bool enable_PWM) {
+asicState asic_chain_pwm_enable(asic_chain* chain, bool enable_PWM) {
   uint16_t pwm_output_state = (enable_PWM ? 0xFFFF : 0x0000);
-  asicState state = asic_write(REG_PWM_EN, pwm_output_state);
-  asic_pwm_sync();
+  asicState state = asic_chain_write(chain, REG_PWM_EN, pwm_output_state);
+  asic_chain_pwm_sync(chain);
 
   return state;
 }
@@ -125,47 +219,37 @@ asicState asic_pwm_enable(bool enable_PWM) {
 /**
  * @brief Configure PWM
  *
+ * @param chain [in] Asic chain
  * @param enable_linear_mode [in] Enable linear mode
  * @param enable_count_from_centre [in] Enable count from centre
  * @return asicState
  */
-asicState asic_pwm_set_config(bool enable_linear_mode, bool enable_count_from_centre) {
-  static const uint16_t DITHER_SEED_COMMIT = 1 << 11;
-  static const uint16_t LINEAR_MODE_DISABLE = 1 << 14;
-  static const uint16_t COUNT_FROM_CENTRE_ENABLE = 1 << 12;
-  static const uint16_t DITHER_SEED_UPPER = 0x00A9;
-  static const uint16_t DITHER_SEED_LOWER = 0x0001;
-  uint16_t data = DITHER_SEED_COMMIT | (DITHER_SEED_UPPER << 2) | DITHER_SEED_LOWER;
-
-  if (!enable_linear_mode) {
-    data |= LINEAR_MODE_DISABLE;
-  }
-
-  if (enable_count_from_centre) {
-    data |= COUNT_FROM_CENTRE_ENABLE;
-  }
-
-  asicState state = asic_write(REG_PWM_CONFIG, data);
-  asic_pwm_sync();
+asicState asic_chain_pwm_set_config(asic_chain* chain, bool enable_linear_mode,
+                                    bool enable_count_from_centre) {
+  asicState state = asic_chain_write(chain, REG_PWM_CONFIG,
+                                     pwm_config(enable_linear_mode, enable_count_from_centre));
+  asic_chain_pwm_sync(chain);
   return state;
 }
 
 /**
  * @brief Enable PWM dither
  *
+ * @param chain [in] Asic chain
  * @param enable_asic_pwm_dither [in] PWM dither
  * @return asicState
  */
-asicState asic_pwm_dither(bool enable_asic_pwm_dither) {
+asicState asic_chain_pwm_dither(asic_chain* chain, bool enable_asic_pwm_dither) {
   uint16_t data = (enable_asic_pwm_dither ? 0xFFFF : 0x0000);
-  asicState state = asic_write(REG_asic_pwm_dither, data);
-  asic_pwm_sync();
+  asicState state = asic_chain_write(chain, REG_asic_pwm_dither, data);
+  asic_chain_pwm_sync(chain);
   return state;
 }
 
 /**
  * @brief Initialise PWM
  *
+ * @param chain [in] Asic chain
  * @param enable_sc [in] Enable short circuit detection
  * @param sc_filter [in] Number of PWM clocks for short detection
  * @param enable_linear_mode [in] Enable linear mode
@@ -173,15 +257,108 @@ asicState asic_pwm_dither(bool enable_asic_pwm_dither) {
  * @param enable_count_from_centre [in] Enable count from centre
  * @return asicState
  */
-asicState asic_pwm_init(bool enable_sc, uint8_t sc_filter, bool enable_linear_mode,
-                        bool enable_asic_pwm_dither, bool enable_count_from_centre) {
-  if ((kAsiceSuccess != asic_pwm_short_circuit_protection_control(enable_sc, sc_filter)) ||
-      (kAsiceSuccess != asic_pwm_short_circuit_clear()) ||
-      (kAsiceSuccess != asic_pwm_set_highz(false)) ||
-      (kAsiceSuccess != asic_pwm_set_config(enable_linear_mode, enable_count_from_centre)) ||
-      (kAsiceSuccess != asic_pwm_dither(enable_asic_pwm_dither)) ||
-      (kAsiceSuccess != asic_pwm_enable(true))) {
+asicState asic_chain_pwm_init(asic_chain* chain, bool enable_sc, uint8_t sc_filter,
+                              bool enable_linear_mode, bool enable_asic_pwm_dither,
+                              bool enable_count_from_centre) {
+  uint16_t config = pwm_config(enable_linear_mode, enable_count_from_centre);
+  const asic_reg_write table[] = {
+      {REG_SHORT_CONFIG, short_config(enable_sc, sc_filter)},
+      /* Clear short circuit flags */
+      {REG_SHORT_DETECT, 0xFFFF},
+      /* Outputs out of hi-z */
+      {REG_PWM_OE, 0xFFFF},
+      {REG_PWM_CONFIG, config},
+      {REG_asic_pwm_dither, enable_asic_pwm_dither ? 0xFFFF : 0x0000},
+      {REG_PWM_EN, 0xFFFF},
+      /* One sync latches everything above */
+      {REG_PWM_CONFIG, config | ASIC_PWM_SYNC},
+  };
+  return asic_chain_write_table(chain, table, sizeof(table) / sizeof(table[0]), false);
+}
+
+/**
+ * @brief Initialise PWM of every asic in the mask at once
+ *
+ * @param chain [in] Asic chain
+ * @param address_mask [in] Bit n set for asic address n
+ * @param enable_sc [in] Enable short circuit detection
+ * @param sc_filter [in] Number of PWM clocks for short detection
+ * @param enable_linear_mode [in] Enable linear mode
+ * @param enable_asic_pwm_dither [in] Enable PWM dither
+ * @param enable_count_from_centre [in] Enable count from centre
+ * @return asicState
+ */
+asicState asic_chain_pwm_init_broadcast(asic_chain* chain, uint8_t address_mask, bool enable_sc,
+                                        uint8_t sc_filter, bool enable_linear_mode,
+                                        bool enable_asic_pwm_dither,
+                                        bool enable_count_from_centre) {
+  if (kAsiceSuccess != asic_chain_broadcast_begin(chain, address_mask)) {
     return kAsiceERR;
   }
-  return kAsiceSuccess;
+
+  asicState state = asic_chain_pwm_init(chain, enable_sc, sc_filter, enable_linear_mode,
+                                        enable_asic_pwm_dither, enable_count_from_centre);
+  asic_chain_broadcast_end(chain);
+  return state;
+}
+
+/* Default chain */
+
+asicState asic_pwm_sync(void) {
+  return asic_chain_pwm_sync(asic_default_chain());
+}
+
+asicState asic_pwm_short_circuit_protection_control(bool enable, uint16_t sc_filter) {
+  return asic_chain_pwm_short_circuit_protection_control(asic_default_chain(), enable, sc_filter);
+}
+
+asicState asic_pwm_short_circuit_clear(void) {
+  return asic_chain_pwm_short_circuit_clear(asic_default_chain());
+}
+
+asicState asic_pwm_short_circuit_get(uint16_t* shorts) {
+  return asic_chain_pwm_short_circuit_get(asic_default_chain(), shorts);
+}
+
+asicState asic_pwm_delay_set(uint16_t delay, uint16_t channel, bool sync) {
+  return asic_chain_pwm_delay_set(asic_default_chain(), delay, channel, sync);
+}
+
+asicState asic_pwm_duty_set(uint16_t duty, uint16_t channel, bool sync) {
+  return asic_chain_pwm_duty_set(asic_default_chain(), duty, channel, sync);
+}
+
+asicState asic_pwm_set_frame(const uint16_t* duty, const uint16_t* delay, uint16_t channel_mask) {
+  return asic_chain_pwm_set_frame(asic_default_chain(), duty, delay, channel_mask);
+}
+
+asicState asic_pwm_set_highz(bool enable_highz) {
+  return asic_chain_pwm_set_highz(asic_default_chain(), enable_highz);
+}
+
+asicState asic_pwm_enable(bool enable_PWM) {
+  return asic_chain_pwm_enable(asic_default_chain(), enable_PWM);
+}
+
+asicState asic_pwm_set_config(bool enable_linear_mode, bool enable_count_from_centre) {
+  return asic_chain_pwm_set_config(asic_default_chain(), enable_linear_mode,
+                                   enable_count_from_centre);
+}
+
+asicState asic_pwm_dither(bool enable_asic_pwm_dither) {
+  return asic_chain_pwm_dither(asic_default_chain(), enable_asic_pwm_dither);
+}
+
+asicState asic_pwm_init(bool enable_sc, uint8_t sc_filter, bool enable_linear_mode,
+                        bool enable_asic_pwm_dither, bool enable_count_from_centre) {
+  return asic_chain_pwm_init(asic_default_chain(), enable_sc, sc_filter, enable_linear_mode,
+                             enable_asic_pwm_dither, enable_count_from_centre);
+}
+
+asicState asic_pwm_init_broadcast(uint8_t address_mask, bool enable_sc, uint8_t sc_filter,
+                                  bool enable_linear_mode, bool enable_asic_pwm_dither,
+                                  bool enable_count_from_centre) {
+  return asic_chain_pwm_init_broadcast(asic_default_chain(), address_mask, enable_sc, sc_filter,
+                                       enable_linear_mode, enable_asic_pwm_dither,
+                                       enable_count_from_centre);
 }
\ No newline at end of file
@@ -0,0 +1,313 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "asic_common.h"
+#include "asic_pwm.h"
+#include "asic_pwm_stream.h"
+#include "asic_regs.h"
+#include "asic_spi.h"
+
+/**
+ * @brief Encode the frame headers of both buffers, only the data changes while streaming
+ *
+ * @param stream [in/out] Stream handle
+ */
+static void stream_encode(asic_pwm_stream* stream) {
+  uint16_t count = 0;
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if (0 == (stream->address_mask & (1 << address))) {
+      continue;
+    }
+
+    for (uint16_t channel = 0; channel < ASIC_PWM_CHANNELS; channel++) {
+      uint16_t offset = channel * 2;
+      stream->frames[0][count++] = ASIC_FRAME_HEADER(address, REG_PWM0_DUTY + offset, false);
+      stream->frames[0][count++] = ASIC_FRAME_HEADER(address, REG_PWM0_DELAY + offset, false);
+    }
+    stream->frames[0][count++] = ASIC_FRAME_HEADER(address, REG_PWM_CONFIG, false);
+  }
+  memcpy(stream->frames[1], stream->frames[0], sizeof(stream->frames[0]));
+  stream->count = count;
+}
+
+/**
+ * @brief Patch the oldest frame in the ring into the staging buffer
+ *
+ * Does nothing if a frame is already staged or the ring is empty.
+ *
+ * @param stream [in/out] Stream handle
+ */
+static void stream_stage(asic_pwm_stream* stream) {
+  if (stream->staged_ready || (stream->tail == stream->head)) {
+    return;
+  }
+
+  const asic_pwm_frame* frame = &stream->ring[stream->tail];
+  uint32_t* frames = stream->frames[stream->staged];
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if (0 == (stream->address_mask & (1 << address))) {
+      continue;
+    }
+
+    for (uint16_t channel = 0; channel < ASIC_PWM_CHANNELS; channel++) {
+      frames[0] = ASIC_FRAME_PATCH(frames[0], frame->duty[address][channel]);
+      frames[1] = ASIC_FRAME_PATCH(frames[1], frame->delay[address][channel]);
+      frames += 2;
+    }
+    *frames = ASIC_FRAME_PATCH(*frames, stream->sync[address]);
+    frames++;
+  }
+
+  stream->tail = (stream->tail + 1) % stream->ring_size;
+  stream->staged_ready = true;
+}
+
+static void stream_send(asic_pwm_stream* stream);
+
+/**
+ * @brief Send the frame due unless the send path is held, from either interrupt
+ *
+ * Only the caller that clears overdue while holding the send path sends, so a tick racing a
+ * completion sends the frame exactly once.
+ *
+ * @param stream [in/out] Stream handle
+ */
+static void stream_flush(asic_pwm_stream* stream) {
+  uint8_t idle = 0;
+  while (atomic_load(&stream->overdue) &&
+         atomic_compare_exchange_strong(&stream->in_flight, &idle, 1)) {
+    if (atomic_exchange(&stream->overdue, false) && stream->running) {
+      stream_send(stream);
+      return;
+    }
+    atomic_store(&stream->in_flight, 0);
+    idle = 0;
+  }
+}
+
+/**
+ * @brief Drop one hold on the send path, the last one sends a frame that fell due meanwhile
+ *
+ * @param stream [in/out] Stream handle
+ */
+static void stream_release(asic_pwm_stream* stream) {
+  if (1 == atomic_fetch_sub(&stream->in_flight, 1)) {
+    stream_flush(stream);
+  }
+}
+
+/**
+ * @brief Put the staged frame on the bus and stage the one after it, holding the send path
+ *
+ * Runs from the timer and SPI interrupts, so it never waits for the bus. If something else holds
+ * it the frame stays staged and goes out on the next tick.
+ *
+ * @param stream [in/out] Stream handle
+ */
+static void stream_send(asic_pwm_stream* stream) {
+  stream_stage(stream);
+  if (!stream->staged_ready) {
+    stream->underruns++;
+    stream_release(stream);
+    return;
+  }
+
+  uint8_t buffer = stream->staged;
+  stream->staged ^= 1;
+  stream->staged_ready = false;
+  /* One hold for the frame on the bus, dropped by stream_done, one for the staging below */
+  atomic_store(&stream->in_flight, 2);
+  if (kAsiceSuccess != asic_chain_try_submit_frames(stream->chain, stream->frames[buffer],
+                                                    stream->count, &stream->request)) {
+    atomic_fetch_sub(&stream->in_flight, 1);
+    if (kAsicRequest_Idle == stream->request.state) {
+      stream->staged = buffer;
+      stream->staged_ready = true;
+      atomic_fetch_add(&stream->late, 1);
+      stream_release(stream);
+      return;
+    }
+    stream->errors++;
+  }
+  stream_stage(stream);
+  stream_release(stream);
+}
+
+/**
+ * @brief Request callback, called from the SPI interrupt when a frame has been sent
+ *
+ * @param request [in] Stream request
+ */
+static void stream_done(asic_request* request) {
+  asic_pwm_stream* stream = request->context;
+  if (kAsicRequest_Done == request->state) {
+    stream->sent++;
+  } else {
+    stream->errors++;
+  }
+  stream_release(stream);
+}
+
+/**
+ * @brief Initialise a PWM frame stream
+ *
+ * One slot of the ring is kept free, so it holds ring_size - 1 frames.
+ *
+ * @param chain [in] Asic chain, should not be used by anything else while streaming. With a
+ * semaphore it needs tryLockSem.
+ * @param stream [out] Stream handle
+ * @param ring [in] Frame storage
+ * @param ring_size [in] Number of frames in ring, at least 2
+ * @param address_mask [in] Bit n set for asic address n
+ * @param ticks_per_frame [in] Calls to asic_pwm_stream_tick per frame
+ * @return asicState
+ */
+asicState asic_chain_pwm_stream_init(asic_chain* chain, asic_pwm_stream* stream,
+                                     asic_pwm_frame* ring, uint16_t ring_size,
+                                     uint8_t address_mask, uint16_t ticks_per_frame) {
+  if ((NULL == chain) || (NULL == stream) || (NULL == ring) || (2 > ring_size) ||
+      (0 == address_mask) || (0 == ticks_per_frame)) {
+    return kAsiceERR;
+  }
+  /* Frames are sent from interrupts, a semaphore must be takeable without blocking */
+  if ((NULL != chain->spi.lockSem) && (NULL == chain->spi.tryLockSem)) {
+    return kAsiceERR;
+  }
+
+  memset(stream, 0, sizeof(*stream));
+  stream->chain = chain;
+  stream->address_mask = address_mask;
+  stream->ring = ring;
+  stream->ring_size = ring_size;
+  stream->ticks_per_frame = ticks_per_frame;
+  stream->request.callback = stream_done;
+  stream->request.context = stream;
+  atomic_init(&stream->in_flight, 0);
+  atomic_init(&stream->overdue, false);
+  atomic_init(&stream->late, 0);
+  stream_encode(stream);
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Get the next free slot of the ring
+ *
+ * @param stream [in] Stream handle
+ * @return asic_pwm_frame* Frame to fill, NULL if the ring is full
+ */
+asic_pwm_frame* asic_pwm_stream_next(asic_pwm_stream* stream) {
+  if (0 == asic_pwm_stream_free(stream)) {
+    return NULL;
+  }
+  return &stream->ring[stream->head];
+}
+
+/**
+ * @brief Queue the frame returned by asic_pwm_stream_next
+ *
+ * @param stream [in/out] Stream handle
+ * @return asicState
+ */
+asicState asic_pwm_stream_push(asic_pwm_stream* stream) {
+  if (0 == asic_pwm_stream_free(stream)) {
+    return kAsiceERR;
+  }
+
+  stream->head = (stream->head + 1) % stream->ring_size;
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Number of frames that can be queued
+ *
+ * @param stream [in] Stream handle
+ * @return uint16_t
+ */
+uint16_t asic_pwm_stream_free(const asic_pwm_stream* stream) {
+  return (stream->tail + stream->ring_size - stream->head - 1) % stream->ring_size;
+}
+
+/**
+ * @brief Start playback, the first frame is sent on the next update period
+ *
+ * Reads the PWM config of each asic so the sync writes keep it unchanged. The config must not be
+ * changed while streaming.
+ *
+ * @param stream [in/out] Stream handle
+ * @return asicState
+ */
+asicState asic_pwm_stream_start(asic_pwm_stream* stream) {
+  asic_chain* chain = stream->chain;
+  uint32_t address = chain->address;
+  for (uint32_t i = 0; i < ASIC_MAX_DEVICES; i++) {
+    if (0 == (stream->address_mask & (1 << i))) {
+      continue;
+    }
+
+    uint16_t data;
+    if ((kAsiceSuccess != asic_chain_set_address(chain, i)) ||
+        (kAsiceSuccess > asic_chain_read_cached(chain, REG_PWM_CONFIG, &data))) {
+      asic_chain_set_address(chain, address);
+      return kAsiceERR;
+    }
+    stream->sync[i] = data | ASIC_PWM_SYNC;
+  }
+  asic_chain_set_address(chain, address);
+
+  stream->ticks = 0;
+  stream->overdue = false;
+  stream->sent = 0;
+  stream->underruns = 0;
+  stream->late = 0;
+  stream->errors = 0;
+  stream_stage(stream);
+  stream->running = true;
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Stop playback, a frame already on the bus is still completed
+ *
+ * @param stream [in/out] Stream handle
+ */
+void asic_pwm_stream_stop(asic_pwm_stream* stream) {
+  stream->running = false;
+  stream->overdue = false;
+}
+
+/**
+ * @brief Advance the update timer, call at a fixed rate (e.g. from a timer interrupt)
+ *
+ * A frame still on the bus when the next is due is counted as late, and the next frame follows
+ * as soon as it completes. A due frame with nothing in the ring is counted as an underrun and the
+ * outputs keep their last values.
+ *
+ * @param stream [in/out] Stream handle
+ */
+void asic_pwm_stream_tick(asic_pwm_stream* stream) {
+  if (!stream->running) {
+    return;
+  }
+
+  if (++stream->ticks < stream->ticks_per_frame) {
+    return;
+  }
+  stream->ticks = 0;
+
+  if (0 != atomic_load(&stream->in_flight)) {
+    atomic_fetch_add(&stream->late, 1);
+  }
+  /* Set before looking at the send path, so a completion in between still sees it */
+  atomic_store(&stream->overdue, true);
+  stream_flush(stream);
+}
+
+/* Default chain */
+
+asicState asic_pwm_stream_init(asic_pwm_stream* stream, asic_pwm_frame* ring, uint16_t ring_size,
+                               uint8_t address_mask, uint16_t ticks_per_frame) {
+  return asic_chain_pwm_stream_init(asic_default_chain(), stream, ring, ring_size, address_mask,
+                                    ticks_per_frame);
+}
\ No newline at end of file
@@ -0,0 +1,523 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "asic_common.h"
+#include "asic_pwm.h"
+#include "asic_queue.h"
+#include "asic_regs.h"
+#include "asic_spi.h"
+
+/**
+ * @brief Claim the next free slot and publish a command in it
+ *
+ * A producer interrupted between claim and publish only holds up the owner, which stops at
+ * the unpublished slot and picks it up on a later service.
+ *
+ * @param queue [in/out] Queue handle
+ * @param command [in] Command to queue
+ * @return asicState error if the ring is full
+ */
+static asicState queue_push(asic_queue* queue, const asic_command* command) {
+  uint32_t position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  asic_queue_slot* slot;
+  for (;;) {
+    slot = &queue->slots[position & queue->mask];
+    uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    int32_t lag = (int32_t)(sequence - position);
+    if (0 == lag) {
+      if (atomic_compare_exchange_weak_explicit(&queue->head, &position, position + 1,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+        break;
+      }
+    } else if (0 > lag) {
+      /* Slot not drained yet since the last lap */
+      atomic_fetch_add_explicit(&queue->full, 1, memory_order_relaxed);
+      return kAsiceERR;
+    } else {
+      position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    }
+  }
+
+  slot->command = *command;
+  slot->command.time = (NULL != queue->timestamp) ? queue->timestamp() : 0;
+  atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Take the oldest published command, owner only
+ *
+ * @param queue [in/out] Queue handle
+ * @param command [out] Command
+ * @return true command taken
+ * @return false ring empty, or the oldest slot is still being written
+ */
+static bool queue_pop(asic_queue* queue, asic_command* command) {
+  asic_queue_slot* slot = &queue->slots[queue->tail & queue->mask];
+  uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+  if (sequence != (queue->tail + 1)) {
+    return false;
+  }
+
+  *command = slot->command;
+  atomic_store_explicit(&slot->sequence, queue->tail + queue->mask + 1, memory_order_release);
+  queue->tail++;
+  return true;
+}
+
+/**
+ * @brief Complete the request of a drained command
+ *
+ * @param request [in/out] Completion slot, NULL for none
+ * @param response [in] Frame clocked back
+ * @param state [in] Transfer result
+ */
+static void queue_complete(asic_request* request, uint32_t response, asicState state) {
+  if (NULL == request) {
+    return;
+  }
+
+  if (kAsiceSuccess == state) {
+    request->read_data = response;
+    if (NULL != request->data) {
+      *request->data = (uint16_t)(response & 0xFFFF);
+    }
+  }
+  request->state = (kAsiceSuccess == state) ? kAsicRequest_Done : kAsicRequest_Error;
+  if (NULL != request->callback) {
+    request->callback(request);
+  }
+}
+
+/**
+ * @brief Send single frame commands as one transfer and complete them
+ *
+ * @param queue [in/out] Queue handle
+ * @param tx [in] Frames
+ * @param requests [in] Completion slot of each frame, NULL entries for none
+ * @param count [in] Number of frames
+ * @return asicState
+ */
+static asicState queue_send(asic_queue* queue, const uint32_t* tx, asic_request* const* requests,
+                            uint16_t count) {
+  uint32_t rx[ASIC_QUEUE_BATCH];
+  asicState state = asic_chain_transfer_frames(queue->chain, tx, rx, count);
+  queue->commands += count;
+  queue->transfers++;
+  for (uint16_t i = 0; i < count; i++) {
+    queue_complete(requests[i], rx[i], state);
+  }
+  return state;
+}
+
+/**
+ * @brief Set up a command ring on a chain
+ *
+ * @param chain [in] Asic chain
+ * @param queue [out] Queue handle
+ * @param slots [in] Ring storage, must stay valid while the queue is in use
+ * @param size [in] Slots in the ring, a power of two
+ * @return asicState
+ */
+asicState asic_chain_queue_init(asic_chain* chain, asic_queue* queue, asic_queue_slot* slots,
+                                uint32_t size) {
+  if ((NULL == chain) || (NULL == queue) || (NULL == slots) || (0 == size) ||
+      (0 != (size & (size - 1)))) {
+    return kAsiceERR;
+  }
+
+  queue->chain = chain;
+  queue->slots = slots;
+  queue->mask = size - 1;
+  for (uint32_t i = 0; i < size; i++) {
+    atomic_init(&slots[i].sequence, i);
+  }
+  atomic_init(&queue->head, 0);
+  queue->tail = 0;
+  atomic_init(&queue->full, 0);
+  queue->commands = 0;
+  queue->transfers = 0;
+  queue->timestamp = NULL;
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Queue a register write, safe from any task or interrupt
+ *
+ * @param queue [in/out] Queue handle
+ * @param address [in] Asic address
+ * @param reg [in] Asic register
+ * @param data [in] Value to write
+ * @param request [in/out] Optional, completed by the owner once the write is on the bus
+ * @return asicState error if the ring is full
+ */
+asicState asic_queue_write(asic_queue* queue, uint32_t address, asicReg reg, uint16_t data,
+                           asic_request* request) {
+  asic_command command = {.frame = asic_frame_encode(address, reg, false, data),
+                          .request = request};
+  if (NULL != request) {
+    request->data = NULL;
+    request->frame = command.frame;
+    request->state = kAsicRequest_Pending;
+  }
+  if (kAsiceSuccess != queue_push(queue, &command)) {
+    if (NULL != request) {
+      request->state = kAsicRequest_Idle;
+    }
+    return kAsiceERR;
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Queue a register read, safe from any task or interrupt
+ *
+ * @param queue [in/out] Queue handle
+ * @param address [in] Asic address
+ * @param reg [in] Asic register
+ * @param data [out] Read destination, written by the owner before the request completes
+ * @param request [in/out] Completion slot, must stay valid until completed
+ * @return asicState error if the ring is full
+ */
+asicState asic_queue_read(asic_queue* queue, uint32_t address, asicReg reg, uint16_t* data,
+                          asic_request* request) {
+  if ((NULL == data) || (NULL == request)) {
+    return kAsiceERR;
+  }
+
+  asic_command command = {.frame = asic_frame_encode(address, reg, true, 0), .request = request};
+  request->data = data;
+  request->frame = command.frame;
+  request->state = kAsicRequest_Pending;
+  if (kAsiceSuccess != queue_push(queue, &command)) {
+    request->state = kAsicRequest_Idle;
+    return kAsiceERR;
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Queue a batch of write frames, safe from any task or interrupt
+ *
+ * The batch is sent as one transfer, in order with the other commands of the queue.
+ *
+ * @param queue [in/out] Queue handle
+ * @param frames [in] Frames from asic_frame_encode, must stay valid until the request completes
+ * @param count [in] Number of frames
+ * @param request [in/out] Completion slot, must stay valid until completed
+ * @return asicState error if the ring is full
+ */
+asicState asic_queue_submit(asic_queue* queue, const uint32_t* frames, uint16_t count,
+                            asic_request* request) {
+  if ((NULL == frames) || (0 == count) || (NULL == request)) {
+    return kAsiceERR;
+  }
+
+  asic_command command = {.frames = frames, .count = count, .request = request};
+  request->data = NULL;
+  request->state = kAsicRequest_Pending;
+  if (kAsiceSuccess != queue_push(queue, &command)) {
+    request->state = kAsicRequest_Idle;
+    return kAsiceERR;
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Drain the ring onto the bus, call from the owner context only
+ *
+ * Sends every published command, single frames ASIC_QUEUE_BATCH per transfer and batches as
+ * they are, and completes their requests (callbacks run in the owner context).
+ *
+ * @param queue [in/out] Queue handle
+ * @return asicState error if any transfer failed, its requests are completed with an error
+ */
+asicState asic_queue_service(asic_queue* queue) {
+  uint32_t tx[ASIC_QUEUE_BATCH];
+  asic_request* requests[ASIC_QUEUE_BATCH];
+  asicState result = kAsiceSuccess;
+  for (;;) {
+    asic_command command;
+    bool batch = false;
+    uint16_t count = 0;
+    while ((count < ASIC_QUEUE_BATCH) && queue_pop(queue, &command)) {
+      if (NULL != command.frames) {
+        batch = true;
+        break;
+      }
+      tx[count] = command.frame;
+      requests[count++] = command.request;
+    }
+    if (!batch && (0 == count)) {
+      return result;
+    }
+
+    if ((0 != count) && (kAsiceSuccess != queue_send(queue, tx, requests, count))) {
+      result = kAsiceERR;
+    }
+    if (batch) {
+      asicState state = asic_chain_transfer_frames(queue->chain, command.frames, NULL,
+                                                   command.count);
+      queue->commands++;
+      queue->transfers++;
+      queue_complete(command.request, 0, state);
+      if (kAsiceSuccess != state) {
+        result = kAsiceERR;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Take the next command of a class, owner only
+ *
+ * @param priority_class [in/out] Scheduler class
+ * @return true command taken
+ * @return false nothing queued
+ */
+static bool sched_next(asic_sched_class* priority_class) {
+  if (!queue_pop(&priority_class->queue, &priority_class->current)) {
+    return false;
+  }
+  priority_class->active = true;
+  priority_class->sent = 0;
+  return true;
+}
+
+/**
+ * @brief Record the queueing latency of the current command as its first frame goes out
+ *
+ * @param priority_class [in/out] Scheduler class
+ */
+static void sched_started(asic_sched_class* priority_class) {
+  uint32_t (*timestamp)(void) = priority_class->queue.timestamp;
+  if (NULL == timestamp) {
+    return;
+  }
+
+  priority_class->latency = timestamp() - priority_class->current.time;
+  if (priority_class->latency > priority_class->latency_max) {
+    priority_class->latency_max = priority_class->latency;
+  }
+}
+
+/**
+ * @brief Send up to one slice of a class
+ *
+ * A batch sends its next slice frames. Single frames of the class are gathered, up to slice of
+ * them, into one transfer.
+ *
+ * @param sched [in/out] Scheduler
+ * @param priority_class [in/out] Class with an active command
+ * @return asicState
+ */
+static asicState sched_send(asic_sched* sched, asic_sched_class* priority_class) {
+  asic_queue* queue = &priority_class->queue;
+  asic_command* command = &priority_class->current;
+  if (NULL != command->frames) {
+    if (0 == priority_class->sent) {
+      sched_started(priority_class);
+    }
+
+    const uint32_t* tx = &command->frames[priority_class->sent];
+    uint16_t remaining = command->count - priority_class->sent;
+    uint16_t frames = (remaining < sched->slice) ? remaining : sched->slice;
+    asicState state = asic_chain_transfer_frames(sched->chain, tx, NULL, frames);
+    queue->transfers++;
+    priority_class->sent += frames;
+    if ((kAsiceSuccess != state) || (command->count == priority_class->sent)) {
+      queue->commands++;
+      priority_class->active = false;
+      queue_complete(command->request, 0, state);
+    }
+    return state;
+  }
+
+  uint32_t tx[ASIC_QUEUE_BATCH];
+  asic_request* requests[ASIC_QUEUE_BATCH];
+  uint16_t count = 0;
+  do {
+    sched_started(priority_class);
+    tx[count] = command->frame;
+    requests[count++] = command->request;
+    priority_class->active = false;
+  } while ((count < sched->slice) && sched_next(priority_class) && (NULL == command->frames));
+  return queue_send(queue, tx, requests, count);
+}
+
+/**
+ * @brief Set up a scheduler with one command ring per class
+ *
+ * @param chain [in] Asic chain
+ * @param sched [out] Scheduler
+ * @param slots [in] kAsicClass_Count * size slots, must stay valid while in use
+ * @param size [in] Slots per class, a power of two
+ * @param slice [in] 1 - ASIC_QUEUE_BATCH frames sent before more urgent classes are checked
+ * @param address_mask [in] Asics covered by asic_sched_highz, their PWM_CONFIG is read now
+ * @return asicState
+ */
+asicState asic_chain_sched_init(asic_chain* chain, asic_sched* sched, asic_queue_slot* slots,
+                                uint32_t size, uint16_t slice, uint8_t address_mask) {
+  if ((NULL == sched) || (NULL == slots) || (0 == slice) || (ASIC_QUEUE_BATCH < slice)) {
+    return kAsiceERR;
+  }
+
+  memset(sched, 0, sizeof(*sched));
+  sched->chain = chain;
+  sched->slice = slice;
+  sched->address_mask = address_mask;
+  sched->last = kAsicClass_Housekeeping;
+  for (uint32_t i = 0; i < kAsicClass_Count; i++) {
+    if (kAsiceSuccess != asic_chain_queue_init(chain, &sched->classes[i].queue, &slots[i * size],
+                                               size)) {
+      return kAsiceERR;
+    }
+  }
+
+  if (0 != address_mask) {
+    if (kAsiceSuccess != asic_chain_read_each(chain, address_mask, REG_PWM_CONFIG, sched->sync)) {
+      return kAsiceERR;
+    }
+    for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+      sched->sync[address] |= ASIC_PWM_SYNC;
+    }
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Set the timestamp hook used for queueing latency
+ *
+ * @param sched [in/out] Scheduler
+ * @param timestamp [in] Free running counter, NULL to stop timing
+ */
+void asic_sched_set_clock(asic_sched* sched, uint32_t (*timestamp)(void)) {
+  for (uint32_t i = 0; i < kAsicClass_Count; i++) {
+    sched->classes[i].queue.timestamp = timestamp;
+  }
+}
+
+/**
+ * @brief Queue a register write in a class, safe from any task or interrupt
+ *
+ * @param sched [in/out] Scheduler
+ * @param priority [in] Traffic class
+ * @param address [in] Asic address
+ * @param reg [in] Asic register
+ * @param data [in] Value to write
+ * @param request [in/out] Optional, completed by the owner once the write is on the bus
+ * @return asicState error if the class ring is full
+ */
+asicState asic_sched_write(asic_sched* sched, asicClass priority, uint32_t address, asicReg reg,
+                           uint16_t data, asic_request* request) {
+  if (kAsicClass_Count <= priority) {
+    return kAsiceERR;
+  }
+  return asic_queue_write(&sched->classes[priority].queue, address, reg, data, request);
+}
+
+/**
+ * @brief Queue a register read in a class, safe from any task or interrupt
+ *
+ * @param sched [in/out] Scheduler
+ * @param priority [in] Traffic class
+ * @param address [in] Asic address
+ * @param reg [in] Asic register
+ * @param data [out] Read destination, written by the owner before the request completes
+ * @param request [in/out] Completion slot, must stay valid until completed
+ * @return asicState error if the class ring is full
+ */
+asicState asic_sched_read(asic_sched* sched, asicClass priority, uint32_t address, asicReg reg,
+                          uint16_t* data, asic_request* request) {
+  if (kAsicClass_Count <= priority) {
+    return kAsiceERR;
+  }
+  return asic_queue_read(&sched->classes[priority].queue, address, reg, data, request);
+}
+
+/**
+ * @brief Queue a batch of write frames in a class, safe from any task or interrupt
+ *
+ * More urgent classes are served between its slices.
+ *
+ * @param sched [in/out] Scheduler
+ * @param priority [in] Traffic class
+ * @param frames [in] Frames from asic_frame_encode, must stay valid until the request completes
+ * @param count [in] Number of frames
+ * @param request [in/out] Completion slot, must stay valid until completed
+ * @return asicState error if the class ring is full
+ */
+asicState asic_sched_submit(asic_sched* sched, asicClass priority, const uint32_t* frames,
+                            uint16_t count, asic_request* request) {
+  if (kAsicClass_Count <= priority) {
+    return kAsiceERR;
+  }
+  return asic_queue_submit(&sched->classes[priority].queue, frames, count, request);
+}
+
+/**
+ * @brief Put asics into high-Z as safety traffic, safe from any task or interrupt
+ *
+ * Two frames per asic, sent after at most one slice of less urgent traffic.
+ *
+ * @param sched [in/out] Scheduler
+ * @param address_mask [in] Bit n set for asic address n, limited to the init mask
+ * @return asicState error if the safety ring is full
+ */
+asicState asic_sched_highz(asic_sched* sched, uint8_t address_mask) {
+  asic_queue* queue = &sched->classes[kAsicClass_Safety].queue;
+  address_mask &= sched->address_mask;
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if ((0 != (address_mask & (1 << address))) &&
+        ((kAsiceSuccess != asic_queue_write(queue, address, REG_PWM_OE, 0x0000, NULL)) ||
+         (kAsiceSuccess !=
+          asic_queue_write(queue, address, REG_PWM_CONFIG, sched->sync[address], NULL)))) {
+      return kAsiceERR;
+    }
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Send queued traffic, most urgent class first, call from the owner context only
+ *
+ * Returns once every class is empty.
+ *
+ * @param sched [in/out] Scheduler
+ * @return asicState error if any transfer failed, its requests are completed with an error
+ */
+asicState asic_sched_service(asic_sched* sched) {
+  asicState result = kAsiceSuccess;
+  for (;;) {
+    asicClass priority = kAsicClass_Safety;
+    while ((kAsicClass_Count != priority) && !sched->classes[priority].active &&
+           !sched_next(&sched->classes[priority])) {
+      priority++;
+    }
+    if (kAsicClass_Count == priority) {
+      return result;
+    }
+
+    asic_sched_class* last = &sched->classes[sched->last];
+    if ((priority < sched->last) && last->active) {
+      last->preemptions++;
+    }
+    sched->last = priority;
+    if (kAsiceSuccess != sched_send(sched, &sched->classes[priority])) {
+      result = kAsiceERR;
+    }
+  }
+}
+
+/* Default chain */
+
+asicState asic_queue_init(asic_queue* queue, asic_queue_slot* slots, uint32_t size) {
+  return asic_chain_queue_init(asic_default_chain(), queue, slots, size);
+}
+
+asicState asic_sched_init(asic_sched* sched, asic_queue_slot* slots, uint32_t size,
+                          uint16_t slice, uint8_t address_mask) {
+  return asic_chain_sched_init(asic_default_chain(), sched, slots, size, slice, address_mask);
+}
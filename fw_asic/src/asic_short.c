@@ -0,0 +1,159 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "asic_common.h"
+#include "asic_gpio.h"
+#include "asic_pwm.h"
+#include "asic_regs.h"
+#include "asic_short.h"
+#include "asic_spi.h"
+
+/**
+ * @brief Read the short flags of every monitored asic and act on them
+ *
+ * Costs one read per monitored asic, plus one transfer of up to three writes per shorted asic.
+ *
+ * @param monitor [in/out] Monitor handle
+ * @param start [in] Time the short was signalled
+ * @return asicState
+ */
+static asicState monitor_scan(asic_short_monitor* monitor, uint32_t start) {
+  asic_chain* chain = monitor->chain;
+  monitor->shorted = 0;
+  if (kAsiceSuccess !=
+      asic_chain_read_each(chain, monitor->address_mask, REG_SHORT_DETECT, monitor->shorts)) {
+    return kAsiceERR;
+  }
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if ((0 != (monitor->address_mask & (1 << address))) && (0 != monitor->shorts[address])) {
+      monitor->shorted |= (uint8_t)(1 << address);
+    }
+  }
+  if (0 == monitor->shorted) {
+    return kAsiceSuccess;
+  }
+
+  /* Outputs off first, then clear only the flags seen so a new short raises the pin again */
+  uint32_t frames[3 * ASIC_MAX_DEVICES];
+  asic_batch batch;
+  asic_chain_batch_begin(chain, &batch, frames, 3 * ASIC_MAX_DEVICES);
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if (0 == (monitor->shorted & (1 << address))) {
+      continue;
+    }
+
+    if (monitor->highz) {
+      asic_batch_write_to(&batch, address, REG_PWM_OE, 0x0000);
+      asic_batch_write_to(&batch, address, REG_PWM_CONFIG, monitor->sync[address]);
+    }
+    asic_batch_write_to(&batch, address, REG_SHORT_DETECT, monitor->shorts[address]);
+  }
+  asicState state = asic_batch_submit(&batch);
+
+  if (NULL != monitor->timestamp) {
+    monitor->latency = monitor->timestamp() - start;
+    if (monitor->latency > monitor->latency_max) {
+      monitor->latency_max = monitor->latency;
+    }
+  }
+  monitor->events++;
+  if (NULL != monitor->callback) {
+    monitor->callback(monitor);
+  }
+  return state;
+}
+
+/**
+ * @brief Start monitoring a set of asics for short circuits
+ *
+ * Clears the monitor, so set callback, context and timestamp afterwards. With high-Z enabled
+ * the current PWM_CONFIG of each asic is kept for the sync write, call again after changing it.
+ *
+ * @param chain [in] Asic chain
+ * @param monitor [out] Monitor handle
+ * @param address_mask [in] Bit n set to monitor asic address n
+ * @param gpio_channel [in] 0 - 3 GPIO channel routed to SC detect, -1 to only poll
+ * @param highz [in] High-Z shorted asics as soon as the short is read
+ * @return asicState
+ */
+asicState asic_chain_short_monitor_init(asic_chain* chain, asic_short_monitor* monitor,
+                                        uint8_t address_mask, int8_t gpio_channel, bool highz) {
+  if ((NULL == monitor) || (0 == address_mask) || (gpio_channel > 3)) {
+    return kAsiceERR;
+  }
+
+  memset(monitor, 0, sizeof(*monitor));
+  monitor->chain = chain;
+  monitor->address_mask = address_mask;
+  monitor->highz = highz;
+  if (highz) {
+    if (kAsiceSuccess !=
+        asic_chain_read_each(chain, address_mask, REG_PWM_CONFIG, monitor->sync)) {
+      return kAsiceERR;
+    }
+    for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+      monitor->sync[address] |= ASIC_PWM_SYNC;
+    }
+  }
+
+  if ((0 <= gpio_channel) &&
+      (kAsiceSuccess != asic_chain_gpio_route(chain, address_mask, (uint8_t)gpio_channel,
+                                              kGPIOOutsel_SCDetect))) {
+    return kAsiceERR;
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief SC detect edge hook, call from the host GPIO interrupt
+ *
+ * Only records the trigger, the bus is used from asic_short_monitor_service.
+ *
+ * @param monitor [in/out] Monitor handle
+ */
+void asic_short_monitor_isr(asic_short_monitor* monitor) {
+  if (!monitor->triggered && (NULL != monitor->timestamp)) {
+    monitor->trigger_time = monitor->timestamp();
+  }
+  monitor->triggered = true;
+}
+
+/**
+ * @brief Handle a trigger, call from a high priority task woken by the interrupt
+ *
+ * Does nothing, and doesn't use the bus, if there was no trigger.
+ *
+ * @param monitor [in/out] Monitor handle
+ * @return asicState
+ */
+asicState asic_short_monitor_service(asic_short_monitor* monitor) {
+  if (!monitor->triggered) {
+    return kAsiceSuccess;
+  }
+
+  uint32_t start = monitor->trigger_time;
+  monitor->triggered = false;
+  return monitor_scan(monitor, start);
+}
+
+/**
+ * @brief Read the short flags without a trigger
+ *
+ * For chains without the GPIO route, or as a slow backstop for a missed edge.
+ *
+ * @param monitor [in/out] Monitor handle
+ * @return asicState
+ */
+asicState asic_short_monitor_poll(asic_short_monitor* monitor) {
+  uint32_t start = (NULL != monitor->timestamp) ? monitor->timestamp() : 0;
+  return monitor_scan(monitor, start);
+}
+
+/* Default chain */
+
+asicState asic_short_monitor_init(asic_short_monitor* monitor, uint8_t address_mask,
+                                  int8_t gpio_channel, bool highz) {
+  return asic_chain_short_monitor_init(asic_default_chain(), monitor, address_mask, gpio_channel,
+                                       highz);
+}
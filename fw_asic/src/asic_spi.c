@@ -1,22 +1,114 @@
+#include <stdatomic.h>
+#include <string.h>
+
 #include "Driver_SPI.h"
 #include "asic_common.h"
 #include "asic_regs.h"
 #include "asic_spi.h"
 
-static asic_spi_struct* asic_spi_struct = NULL;
-static uint32_t asicAddress = 0;
+/* Frames per transfer when streaming register tables and burst reads */
+#define ASIC_BURST_FRAMES 32
+
+static asic_chain default_chain;
+
+/* Chain served by each SPI event handler */
+static asic_chain* chains[ASIC_MAX_CHAINS] = {NULL};
 
 static const uint32_t kAsicSpeed = 15000000;  // Hz
 static const uint32_t kSPIConfig = ARM_SPI_MODE_MASTER | ARM_SPI_CPOL1_CPHA0 |
                                    ARM_SPI_DATA_BITS(29) | ARM_SPI_MSB_LSB |
                                    ARM_SPI_SS_MASTER_UNUSED;
-volatile bool busy_flag = false;
 
-static void default_callback(uint32_t event) {
+/* 17:16 - SPIOp, SPI read/write mode */
+static const uint32_t kSpiOpWrite = 0x00;
+static const uint32_t kSpiOpRead = 0x01;
+
+#ifdef ASIC_INSTRUMENTATION
+/**
+ * @brief Current time from the chain's timestamp hook
+ *
+ * @param chain [in] Asic chain
+ * @return uint32_t ticks, 0 without a hook
+ */
+static uint32_t stats_now(const asic_chain* chain) {
+  return (NULL != chain->stats.timestamp) ? chain->stats.timestamp() : 0;
+}
+
+/**
+ * @brief Add a duration to a log2 histogram
+ *
+ * @param histogram [in/out] ASIC_STATS_BUCKETS counters
+ * @param max [in/out] Longest duration seen
+ * @param ticks [in] Duration
+ */
+static void stats_record(uint32_t* histogram, uint32_t* max, uint32_t ticks) {
+  uint32_t bucket = 0;
+  for (uint32_t value = ticks; 0 != value; value >>= 1) {
+    bucket++;
+  }
+  histogram[bucket]++;
+  if (ticks > *max) {
+    *max = ticks;
+  }
+}
+
+/**
+ * @brief Count the frames of a transfer as it is submitted
+ *
+ * @param chain [in] Asic chain
+ * @param tx [in] Frames
+ * @param period [in] Frames in tx
+ * @param count [in] Frames sent
+ */
+static void stats_submit(asic_chain* chain, const uint32_t* tx, uint16_t period, uint16_t count) {
+  asic_stats* stats = &chain->stats;
+  stats->transfers++;
+  stats->frames += count;
+  stats->reset_frames += count;
+  for (uint16_t i = 0; i < count; i++) {
+    uint32_t frame = tx[i % period];
+    uint32_t device = (frame >> 26) & (ASIC_MAX_DEVICES - 1);
+    uint32_t reg = (frame >> 18) & (ASIC_MAX_REGS - 1);
+    if (kSpiOpRead == ((frame >> 16) & 0x3)) {
+      stats->reads[reg]++;
+      stats->device_reads[device]++;
+    } else {
+      stats->writes[reg]++;
+      stats->device_writes[device]++;
+    }
+  }
+  stats->submit_time = stats_now(chain);
+}
+
+/**
+ * @brief Record the latency of the transfer that just finished
+ *
+ * @param chain [in] Asic chain
+ */
+static void stats_complete(asic_chain* chain) {
+  asic_stats* stats = &chain->stats;
+  uint32_t latency = stats_now(chain) - stats->submit_time;
+  stats->busy_time += latency;
+  stats_record(stats->latency, &stats->latency_max, latency);
+}
+
+#define STATS_NOW(chain) stats_now(chain)
+#define STATS_LOCK_WAIT(chain, start) \
+  stats_record((chain)->stats.lock_wait, &(chain)->stats.lock_wait_max, stats_now(chain) - (start))
+#define STATS_SUBMIT(chain, tx, period, count) stats_submit(chain, tx, period, count)
+#define STATS_COMPLETE(chain) stats_complete(chain)
+#else
+#define STATS_NOW(chain) 0
+#define STATS_LOCK_WAIT(chain, start) (void)(start)
+#define STATS_SUBMIT(chain, tx, period, count)
+#define STATS_COMPLETE(chain)
+#endif
+
+static void default_callback(asic_chain* chain, uint32_t event) {
   switch (event) {
     case ARM_SPI_EVENT_TRANSFER_COMPLETE:
-      asic_spi_struct->clearCS();
-      busy_flag = false;
+      chain->spi.clearCS();
+      chain->busy = false;
       break;
     case ARM_SPI_EVENT_DATA_LOST:
       /*  Occurs in slave mode when data is requested/sent by master
@@ -39,88 +131,328 @@ static void default_callback(uint32_t event) {
   }
 }
 
-static void lock(void) {
-  while (busy_flag) {
-    /* Do nothing */
+/**
+ * @brief Bits of a register that must not be served from the shadow
+ *
+ * Status bits and self clearing strobes are masked out of the shadow so a
+ * read-modify-write doesn't replay them. Fully volatile registers return 0xFFFF.
+ *
+ * @param reg [in] Asic register
+ * @return uint16_t volatile bit mask
+ */
+static uint16_t shadow_volatile_bits(asicReg reg) {
+  switch (reg) {
+    case REG_ADC_VAL:
+    case REG_SHORT_DETECT:
+    case REG_GPIO_IN:
+      return 0xFFFF;
+    case REG_ADC_STATE:
+      /* ADC_EN, ADC_DONE and ADC sync */
+      return (1 << 3) | (1 << 4) | (1 << 6);
+    case REG_PWM_CONFIG:
+      /* PWM sync */
+      return (1 << 15);
+    default:
+      return 0x0000;
   }
-  busy_flag = true;
 }
 
-static void unlock(void) {
-  busy_flag = false;
+/**
+ * @brief Record a register value in the shadow
+ *
+ * @param chain [in] Asic chain
+ * @param address [in] Asic address
+ * @param reg [in] Asic register
+ * @param data [in] Register value
+ */
+static void shadow_store(asic_chain* chain, uint32_t address, asicReg reg, uint16_t data) {
+  asic_shadow* shadow = chain->spi.shadow;
+  uint16_t volatile_bits = shadow_volatile_bits(reg);
+  if ((NULL == shadow) || (0xFFFF == volatile_bits)) {
+    return;
+  }
+
+  uint32_t device = address & (ASIC_MAX_DEVICES - 1);
+  uint32_t index = (uint32_t)reg & (ASIC_MAX_REGS - 1);
+  shadow->value[device][index] = data & ~volatile_bits;
+  shadow->valid[device][index / 8] |= (uint8_t)(1 << (index % 8));
 }
 
 /**
- * @brief Initialise the SPI peripheral
+ * @brief Forget the shadow value of a register, it is read from the bus next time
  *
- * @param spi_struct [in] SPI handle
- * @param callback [in] Interrupt callback
- * @return asicState
+ * @param chain [in] Asic chain
+ * @param address [in] Asic address
+ * @param reg [in] Asic register
  */
-asicState asic_initSPI(asic_spi_struct* spi_struct, void (*callback)(uint32_t event)) {
-  asic_spi_struct = spi_struct;
-  if ((NULL == spi_struct) || (NULL == spi_struct->spi)) {
-    return kAsiceERR;
+static void shadow_forget(asic_chain* chain, uint32_t address, asicReg reg) {
+  asic_shadow* shadow = chain->spi.shadow;
+  if (NULL == shadow) {
+    return;
   }
 
-  if ((NULL == spi_struct->setCS) || (NULL == spi_struct->clearCS)) {
-    /* CS control should be set up externally */
-    return kAsiceERR;
+  uint32_t device = address & (ASIC_MAX_DEVICES - 1);
+  uint32_t index = (uint32_t)reg & (ASIC_MAX_REGS - 1);
+  shadow->valid[device][index / 8] &= (uint8_t)~(1 << (index % 8));
+}
+
+/**
+ * @brief Record or forget the registers written by encoded frames, read frames are skipped
+ *
+ * @param chain [in] Asic chain
+ * @param frames [in] Encoded frames
+ * @param count [in] Number of frames
+ * @param store [in] Store the written values, false to forget them
+ */
+static void shadow_frames(asic_chain* chain, const uint32_t* frames, uint16_t count, bool store) {
+  if (NULL == chain->spi.shadow) {
+    return;
   }
 
-  if ((NULL == spi_struct->lockSem) || (NULL == spi_struct->unlockSem)) {
-    /* Use non RTOS flag system */
-    asic_spi_struct->lockSem = lock;
-    asic_spi_struct->unlockSem = unlock;
+  for (uint16_t i = 0; i < count; i++) {
+    uint32_t address = frames[i] >> 26;
+    asicReg reg = (asicReg)((frames[i] >> 18) & 0xFF);
+    if (kSpiOpWrite != ((frames[i] >> 16) & 0x3)) {
+      continue;
+    }
+    if (store) {
+      shadow_store(chain, address, reg, (uint16_t)(frames[i] & ASIC_FRAME_DATA_MASK));
+    } else {
+      shadow_forget(chain, address, reg);
+    }
   }
+}
 
-  if (NULL == callback) {
-    callback = default_callback;
+/**
+ * @brief Take the bus, with the non RTOS flag system if no semaphore was given
+ *
+ * @param chain [in] Asic chain
+ */
+static void lock(asic_chain* chain) {
+  uint32_t start = STATS_NOW(chain);
+  if (NULL != chain->spi.lockSem) {
+    chain->spi.lockSem();
+  } else {
+    while (atomic_exchange(&chain->busy, true)) {
+      /* Do nothing */
+    }
   }
+  STATS_LOCK_WAIT(chain, start);
+}
 
-  ARM_DRIVER_SPI* spi = asic_spi_struct->spi;
-  if ((ARM_DRIVER_OK != spi->Initialize(callback)) ||
-      (ARM_DRIVER_OK != spi->PowerControl(ARM_POWER_FULL)) ||
-      (ARM_DRIVER_OK != spi->Control(kSPIConfig, kAsicSpeed))) {
-    return kAsiceERR;
+/**
+ * @brief Take the bus only if it is free, never blocks so it can be called from an interrupt
+ *
+ * @param chain [in] Asic chain
+ * @return true bus taken
+ * @return false bus held, or a semaphore without tryLockSem
+ */
+static bool try_lock(asic_chain* chain) {
+  uint32_t start = STATS_NOW(chain);
+  if (NULL != chain->spi.lockSem) {
+    if ((NULL == chain->spi.tryLockSem) || !chain->spi.tryLockSem()) {
+      return false;
+    }
+  } else if (atomic_exchange(&chain->busy, true)) {
+    return false;
   }
-  return kAsiceSuccess;
+  STATS_LOCK_WAIT(chain, start);
+  return true;
 }
 
 /**
- * @brief Set address of asic on chain
+ * @brief Release the bus
  *
- * @param address [in] Asic address
- * @return asicState
+ * @param chain [in] Asic chain
  */
-asicState asic_setAddress(uint32_t address) {
-  asicAddress = address;
-  return kAsiceSuccess;
+static void unlock(asic_chain* chain) {
+  if (NULL != chain->spi.unlockSem) {
+    chain->spi.unlockSem();
+    return;
+  }
+
+  chain->busy = false;
 }
 
 /**
- * @brief Write to asic register
+ * @brief Build an asic SPI frame
  *
+ * @param address [in] Asic address
  * @param reg [in] Asic register
- * @param data [in] Value to write
- * @return asicState
+ * @param op [in] SPI read/write mode
+ * @param data [in] Write data
+ * @return uint32_t frame
  */
-asicState asic_write(asicReg reg, uint16_t data) {
+static uint32_t encode_frame(uint32_t address, asicReg reg, uint32_t op, uint16_t data) {
   /*
    * 28:26 - ADev, Device address
    * 25:18 - AReg, Register address
    * 17:16 - SPIOp, SPI read/write mode
-   * 15:0 - WD, Write data
+   * 15:0 - WD/RD, Write/Read data
    */
-  static const uint32_t write_bit = 0x00;
-  uint32_t packet = asicAddress;
-  packet = (packet << 8) | (uint32_t)reg;
-  packet = (packet << 2) | write_bit;
-  packet = (packet << 16) | data;
+  return ASIC_FRAME_HEADER(address, reg, kSpiOpRead == op) | data;
+}
 
-  ARM_DRIVER_SPI* spi = asic_spi_struct->spi;
+/**
+ * @brief Hand the current frame of the transfer to the SPI driver
+ *
+ * @param chain [in] Asic chain
+ * @return true frame started
+ * @return false driver refused the frame, status holds the error
+ */
+static bool transfer_frame(asic_chain* chain) {
+  asic_transfer* transfer = &chain->transfer;
+  ARM_DRIVER_SPI* spi = chain->spi.spi;
+  const uint32_t* tx = &transfer->tx[transfer->index % transfer->period];
   int32_t status;
-  asic_spi_struct->lockSem();
+  if (NULL != transfer->rx) {
+    status = spi->Transfer((const void*)tx, (void*)&transfer->rx[transfer->index], 1);
+  } else {
+    status = spi->Send((const void*)tx, 1);
+  }
+
+  if (ARM_DRIVER_OK != status) {
+    transfer->status = status;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Advance the transfer after a frame has completed
+ *
+ * Called from the SPI interrupt. Between frames the CS is toggled here so
+ * there is no semaphore round trip per register.
+ *
+ * @param chain [in] Asic chain
+ * @return true another frame has been started
+ * @return false transfer finished
+ */
+static bool transfer_next(asic_chain* chain) {
+  asic_transfer* transfer = &chain->transfer;
+  if (transfer->index >= transfer->count) {
+    return false;
+  }
+
+  if (transfer->reset) {
+    transfer->reset = false;
+    chain->spi.setCS();
+    if (transfer_frame(chain)) {
+      return true;
+    }
+  } else if ((transfer->index + 1) < transfer->count) {
+    chain->spi.clearCS();
+    transfer->index++;
+    transfer->reset = true;
+    if (transfer_frame(chain)) {
+      return true;
+    }
+  }
+
+  transfer->index = transfer->count;
+  return false;
+}
+
+/**
+ * @brief SPI driver event handler
+ *
+ * Only the end of a whole transfer is passed on to the interrupt callback.
+ *
+ * @param chain [in] Asic chain the event belongs to
+ * @param event [in] ARM_SPI_EVENT_xxx
+ */
+static void spi_event(asic_chain* chain, uint32_t event) {
+  asic_transfer* transfer = &chain->transfer;
+  if ((ARM_SPI_EVENT_TRANSFER_COMPLETE == event) && transfer_next(chain)) {
+    return;
+  }
+
+  STATS_COMPLETE(chain);
+  asic_request* request = transfer->request;
+  bool success = (ARM_SPI_EVENT_TRANSFER_COMPLETE == event) && (ARM_DRIVER_OK == transfer->status);
+  transfer->request = NULL;
+  if (NULL != chain->callback) {
+    chain->callback(event);
+  } else {
+    default_callback(chain, event);
+  }
+
+  if (NULL == request) {
+    return;
+  }
+  if (success && (NULL != request->data)) {
+    *request->data = (uint16_t)(request->read_data & 0xFFFF);
+  }
+  request->state = success ? kAsicRequest_Done : kAsicRequest_Error;
+  if (NULL != request->callback) {
+    request->callback(request);
+  }
+}
+
+/* The CMSIS driver callback has no context, so each chain slot gets its own */
+static void spi_event0(uint32_t event) {
+  spi_event(chains[0], event);
+}
+
+static void spi_event1(uint32_t event) {
+  spi_event(chains[1], event);
+}
+
+static void spi_event2(uint32_t event) {
+  spi_event(chains[2], event);
+}
+
+static void spi_event3(uint32_t event) {
+  spi_event(chains[3], event);
+}
+
+static const ARM_SPI_SignalEvent_t spi_events[ASIC_MAX_CHAINS] = {spi_event0, spi_event1,
+                                                                  spi_event2, spi_event3};
+
+/**
+ * @brief Address register reads are served from
+ *
+ * While broadcasting every addressed asic holds the same values, so the
+ * lowest one in the mask is read.
+ *
+ * @param chain [in] Asic chain
+ * @return uint32_t Asic address
+ */
+static uint32_t read_address(const asic_chain* chain) {
+  if (0 == chain->broadcast_mask) {
+    return chain->address;
+  }
+
+  uint32_t address = 0;
+  while (0 == (chain->broadcast_mask & (1 << address))) {
+    address++;
+  }
+  return address;
+}
+
+/**
+ * @brief Start clocking out frames. The bus must already be locked.
+ *
+ * Each frame is preceded by a reset frame with CS high.
+ *
+ * @param chain [in] Asic chain
+ * @param tx [in] Frames to send, must stay valid until the transfer completes
+ * @param rx [out] Received frames, NULL if not needed
+ * @param count [in] Number of frames in tx
+ * @param repeat [in] Times tx is sent, must be 1 if rx is used
+ * @param request [in] Asynchronous request completed from the interrupt, NULL if none
+ * @return asicState
+ */
+static asicState transfer_start(asic_chain* chain, const uint32_t* tx, uint32_t* rx,
+                                uint16_t count, uint16_t repeat, asic_request* request) {
+  asic_transfer* transfer = &chain->transfer;
+  transfer->tx = tx;
+  transfer->rx = rx;
+  transfer->period = count;
+  transfer->count = count * repeat;
+  transfer->index = 0;
+  transfer->status = ARM_DRIVER_OK;
+  transfer->request = request;
   /*
    * The asic SPI needs resetting for every transaction. This is achieved by
    * deasserting the CS and sending a couple of clock pulses down sclk.
@@ -128,61 +460,1206 @@ asicState asic_write(asicReg reg, uint16_t data) {
    * and causing lines to go high and low. Just send a full transaction with CS
    * high.
    */
-  status = spi->Send((const void*)&packet, 1);
+  transfer->reset = true;
+  STATS_SUBMIT(chain, tx, count, transfer->count);
+  if (!transfer_frame(chain)) {
+    transfer->index = transfer->count;
+    transfer->request = NULL;
+    unlock(chain);
+    return kAsiceERR;
+  }
+  return kAsiceSuccess;
+}
 
-  asic_spi_struct->lockSem();
-  asic_spi_struct->setCS();
-  status = spi->Send((const void*)&packet, 1);
+/**
+ * @brief Wait for the transfer in progress to finish
+ *
+ * @param chain [in] Asic chain
+ * @return asicState
+ */
+static asicState transfer_wait(asic_chain* chain) {
+  lock(chain);
+  unlock(chain);
+  return (ARM_DRIVER_OK == chain->transfer.status) ? kAsiceSuccess : kAsiceERR;
+}
 
-  if (ARM_DRIVER_OK != status) {
+/**
+ * @brief Send frames and wait for them to complete
+ *
+ * @param chain [in] Asic chain
+ * @param tx [in] Frames to send
+ * @param rx [out] Received frames, NULL if not needed
+ * @param count [in] Number of frames
+ * @return asicState
+ */
+static asicState transfer_blocking(asic_chain* chain, const uint32_t* tx, uint32_t* rx,
+                                   uint16_t count) {
+  lock(chain);
+  if ((kAsiceSuccess != transfer_start(chain, tx, rx, count, 1, NULL)) ||
+      (kAsiceSuccess != transfer_wait(chain))) {
     return kAsiceERR;
   }
   return kAsiceSuccess;
 }
 
 /**
- * @brief Read from asic register
+ * @brief Is a batch frame overwritten by a later frame to the same register?
  *
- * @param reg [in] Asic register
- * @param data [in/out] data pointer
+ * @param frames [in] Batch frames
+ * @param count [in] Number of frames
+ * @param entry [in] Frame to check
+ * @return true later write of the same asic register
+ * @return false last write of the register
+ */
+static bool frame_superseded(const uint32_t* frames, uint16_t count, uint16_t entry) {
+  for (uint16_t i = entry + 1; i < count; i++) {
+    if ((frames[i] >> 18) == (frames[entry] >> 18)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Read written registers back and keep the writes that didn't land
+ *
+ * Volatile bits, fully volatile registers and writes superseded later in the list are not
+ * compared. The mismatched frames are moved to the front of frames, in order.
+ *
+ * @param chain [in] Asic chain
+ * @param frames [in/out] Write frames, mismatched frames on return
+ * @param count [in] Number of frames
+ * @param failed [out] Number of mismatched frames
  * @return asicState
  */
-asicState asic_read(asicReg reg, uint16_t* data) {
-  /*
-   * 28:26 - ADev, Device address
-   * 25:18 - AReg, Register address
-   * 17:16 - SPIOp, SPI read/write mode
-   * 15:0 - RD, Read data
-   */
-  static const uint32_t read_bit = 0x01;
-  uint32_t packet = asicAddress;
-  packet = (packet << 8) | (uint32_t)reg;
-  packet = (packet << 2) | read_bit;
-  packet = (packet << 16);
-
-  ARM_DRIVER_SPI* spi = asic_spi_struct->spi;
-  uint32_t read_data;
-  int32_t status;
-  asic_spi_struct->lockSem();
-  /*
-   * The asic SPI needs resetting for every transaction. This is achieved by
-   * deasserting the CS and sending a couple of clock pulses down sclk.
-   * Sadly it seems you can't reconfigure the transaction size without reinit
-   * and causing lines to go high and low. Just send a full transaction with CS
-   * high.
-   */
-  status = spi->Transfer((const void*)&packet, (void*)&read_data, 1);
+static asicState frames_verify(asic_chain* chain, uint32_t* frames, uint16_t count,
+                               uint16_t* failed) {
+  uint32_t tx[ASIC_BURST_FRAMES];
+  uint32_t rx[ASIC_BURST_FRAMES];
+  uint16_t entries[ASIC_BURST_FRAMES];
+  uint16_t entry = 0;
+  *failed = 0;
+  while (entry < count) {
+    uint16_t reads = 0;
+    for (; (entry < count) && (reads < ASIC_BURST_FRAMES); entry++) {
+      asicReg reg = (asicReg)((frames[entry] >> 18) & 0xFF);
+      if ((0xFFFF != shadow_volatile_bits(reg)) && !frame_superseded(frames, count, entry)) {
+        entries[reads] = entry;
+        tx[reads++] = encode_frame(frames[entry] >> 26, reg, kSpiOpRead, 0);
+      }
+    }
+    if (0 == reads) {
+      continue;
+    }
+
+    if (kAsiceSuccess != transfer_blocking(chain, tx, rx, reads)) {
+      return kAsiceERR;
+    }
+
+    for (uint16_t i = 0; i < reads; i++) {
+      uint32_t frame = frames[entries[i]];
+      uint16_t mask = ~shadow_volatile_bits((asicReg)((frame >> 18) & 0xFF));
+      if (0 != ((rx[i] ^ frame) & mask)) {
+        frames[(*failed)++] = frame;
+      }
+    }
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Check sent writes for CRC errors and send the corrupted ones again
+ *
+ * With a CRC error pin only the pin is read while the link is clean, so the check costs
+ * nothing per register. Once it is raised, or without a pin, the writes are read back and
+ * only the mismatched ones are retransmitted, up to chain->retries times.
+ *
+ * @param chain [in] Asic chain
+ * @param frames [in/out] Write frames already sent, reused for the retransmissions
+ * @param count [in] Number of frames
+ * @return asicState error if writes are still wrong after every retry
+ */
+static asicState frames_check(asic_chain* chain, uint32_t* frames, uint16_t count) {
+  if (0 == chain->retries) {
+    return kAsiceSuccess;
+  }
+
+  chain->retry.checks++;
+  if ((NULL != chain->crc_error) && !chain->crc_error()) {
+    return kAsiceSuccess;
+  }
+
+  uint16_t failed = count;
+  for (uint8_t retry = 0;; retry++) {
+    if (kAsiceSuccess != frames_verify(chain, frames, failed, &failed)) {
+      return kAsiceERR;
+    }
+    if (0 == failed) {
+      return kAsiceSuccess;
+    }
+    if (0 == retry) {
+      chain->retry.crc_errors++;
+    }
+    if (chain->retries == retry) {
+      break;
+    }
 
-  asic_spi_struct->lockSem();
-  asic_spi_struct->setCS();
-  status = spi->Transfer((const void*)&packet, (void*)&read_data, 1);
-  asic_spi_struct->lockSem();
-  asic_spi_struct->unlockSem();
+    chain->retry.retransmits += failed;
+    if (kAsiceSuccess != transfer_blocking(chain, frames, NULL, failed)) {
+      return kAsiceERR;
+    }
+  }
+
+  /* The shadow holds values the asics never took */
+  chain->retry.failures++;
+  asic_chain_shadow_invalidate(chain);
+  return kAsiceERR;
+}
+
+/**
+ * @brief Chain used by the functions without a chain parameter
+ *
+ * @return asic_chain*
+ */
+asic_chain* asic_default_chain(void) {
+  return &default_chain;
+}
+
+/**
+ * @brief Initialise a chain and its SPI peripheral
+ *
+ * Up to ASIC_MAX_CHAINS chains, each on its own SPI peripheral, can be in use
+ * at once.
+ *
+ * @param chain [in/out] Chain handle, must stay valid while the chain is in use
+ * @param spi_struct [in] SPI handle (copied)
+ * @param callback [in] Interrupt callback
+ * @return asicState
+ */
+asicState asic_chain_init(asic_chain* chain, asic_spi_struct* spi_struct,
+                          void (*callback)(uint32_t event)) {
+  if ((NULL == chain) || (NULL == spi_struct) || (NULL == spi_struct->spi)) {
+    return kAsiceERR;
+  }
+
+  if ((NULL == spi_struct->setCS) || (NULL == spi_struct->clearCS)) {
+    /* CS control should be set up externally */
+    return kAsiceERR;
+  }
+
+  uint32_t slot = 0;
+  while ((slot < ASIC_MAX_CHAINS) && (chain != chains[slot])) {
+    slot++;
+  }
+  if (ASIC_MAX_CHAINS == slot) {
+    slot = 0;
+    while ((slot < ASIC_MAX_CHAINS) && (NULL != chains[slot])) {
+      slot++;
+    }
+    if (ASIC_MAX_CHAINS == slot) {
+      return kAsiceERR;
+    }
+  }
+
+  memset(chain, 0, sizeof(*chain));
+  chain->spi = *spi_struct;
+  if ((NULL == spi_struct->lockSem) || (NULL == spi_struct->unlockSem)) {
+    /* Use non RTOS flag system */
+    chain->spi.lockSem = NULL;
+    chain->spi.unlockSem = NULL;
+    chain->spi.tryLockSem = NULL;
+  }
+  chain->callback = callback;
+  chains[slot] = chain;
+
+  asic_chain_shadow_invalidate(chain);
+
+  ARM_DRIVER_SPI* spi = chain->spi.spi;
+  if ((ARM_DRIVER_OK != spi->Initialize(spi_events[slot])) ||
+      (ARM_DRIVER_OK != spi->PowerControl(ARM_POWER_FULL)) ||
+      (ARM_DRIVER_OK != spi->Control(kSPIConfig, kAsicSpeed))) {
+    return kAsiceERR;
+  }
+  chain->speed = kAsicSpeed;
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Set address of asic on chain
+ *
+ * @param chain [in] Asic chain
+ * @param address [in] Asic address
+ * @return asicState
+ */
+asicState asic_chain_set_address(asic_chain* chain, uint32_t address) {
+  chain->address = address;
+  return kAsiceSuccess;
+}
 
+/**
+ * @brief Change the SPI clock, waits for the transfer in progress to finish
+ *
+ * @param chain [in] Asic chain
+ * @param speed [in] Bus speed in Hz
+ * @return asicState
+ */
+asicState asic_chain_set_speed(asic_chain* chain, uint32_t speed) {
+  lock(chain);
+  int32_t status = chain->spi.spi->Control(ARM_SPI_SET_BUS_SPEED, speed);
+  unlock(chain);
   if (ARM_DRIVER_OK != status) {
     return kAsiceERR;
   }
 
-  *data = (uint16_t)(read_data & 0xFFFF);
+  chain->speed = speed;
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Address every asic in the mask at once
+ *
+ * Until asic_chain_broadcast_end every write and batch write on the chain goes
+ * to all asics in the mask, and reads come from the lowest addressed one.
+ *
+ * @param chain [in] Asic chain
+ * @param address_mask [in] Bit n set for asic address n
+ * @return asicState
+ */
+asicState asic_chain_broadcast_begin(asic_chain* chain, uint8_t address_mask) {
+  if (0 == address_mask) {
+    return kAsiceERR;
+  }
+
+  chain->broadcast_mask = address_mask;
   return kAsiceSuccess;
 }
+
+/**
+ * @brief Go back to addressing the asic set with asic_chain_set_address
+ *
+ * @param chain [in] Asic chain
+ * @return asicState
+ */
+asicState asic_chain_broadcast_end(asic_chain* chain) {
+  chain->broadcast_mask = 0;
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Write one register value to every asic in the mask
+ *
+ * The writes are sent as a single batch.
+ *
+ * @param chain [in] Asic chain
+ * @param address_mask [in] Bit n set for asic address n
+ * @param reg [in] Asic register
+ * @param data [in] Value to write
+ * @return asicState
+ */
+asicState asic_chain_broadcast_write(asic_chain* chain, uint8_t address_mask, asicReg reg,
+                                     uint16_t data) {
+  uint32_t frames[ASIC_MAX_DEVICES];
+  asic_batch batch;
+  if ((0 == address_mask) ||
+      (kAsiceSuccess != asic_chain_batch_begin(chain, &batch, frames, ASIC_MAX_DEVICES))) {
+    return kAsiceERR;
+  }
+
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if (0 != (address_mask & (1 << address))) {
+      asic_batch_write_to(&batch, address, reg, data);
+    }
+  }
+  return asic_batch_submit(&batch);
+}
+
+/**
+ * @brief Write to asic register
+ *
+ * @param chain [in] Asic chain
+ * @param reg [in] Asic register
+ * @param data [in] Value to write
+ * @return asicState
+ */
+asicState asic_chain_write(asic_chain* chain, asicReg reg, uint16_t data) {
+  if (0 != chain->broadcast_mask) {
+    return asic_chain_broadcast_write(chain, chain->broadcast_mask, reg, data);
+  }
+
+  if (0 != chain->retries) {
+    uint32_t frame = encode_frame(chain->address, reg, kSpiOpWrite, data);
+    if (kAsiceSuccess != transfer_blocking(chain, &frame, NULL, 1)) {
+      return kAsiceERR;
+    }
+    shadow_store(chain, chain->address, reg, data);
+    return frames_check(chain, &frame, 1);
+  }
+
+  lock(chain);
+  chain->transfer.frame = encode_frame(chain->address, reg, kSpiOpWrite, data);
+  if (kAsiceSuccess != transfer_start(chain, &chain->transfer.frame, NULL, 1, 1, NULL)) {
+    return kAsiceERR;
+  }
+
+  shadow_store(chain, chain->address, reg, data);
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Read from asic register
+ *
+ * @param chain [in] Asic chain
+ * @param reg [in] Asic register
+ * @param data [in/out] data pointer
+ * @return asicState
+ */
+asicState asic_chain_read(asic_chain* chain, asicReg reg, uint16_t* data) {
+  asic_transfer* transfer = &chain->transfer;
+  uint32_t address = read_address(chain);
+  lock(chain);
+  transfer->frame = encode_frame(address, reg, kSpiOpRead, 0);
+  if ((kAsiceSuccess !=
+       transfer_start(chain, &transfer->frame, &transfer->read_data, 1, 1, NULL)) ||
+      (kAsiceSuccess != transfer_wait(chain))) {
+    return kAsiceERR;
+  }
+
+  *data = (uint16_t)(transfer->read_data & 0xFFFF);
+  shadow_store(chain, address, reg, *data);
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Read a list of registers from the current asic
+ *
+ * Each chunk of ASIC_BURST_FRAMES registers is one locked transfer chained from the SPI
+ * interrupt, so there is no lock handoff or task wake up per register. Every register still
+ * needs its own reset frame.
+ *
+ * @param chain [in] Asic chain
+ * @param regs [in] Registers to read
+ * @param count [in] Number of registers
+ * @param data [out] count register values
+ * @return asicState
+ */
+asicState asic_chain_read_burst(asic_chain* chain, const asicReg* regs, uint16_t count,
+                                uint16_t* data) {
+  if ((NULL == regs) || (NULL == data)) {
+    return kAsiceERR;
+  }
+
+  uint32_t tx[ASIC_BURST_FRAMES];
+  uint32_t rx[ASIC_BURST_FRAMES];
+  uint32_t address = read_address(chain);
+  for (uint16_t start = 0; start < count; start += ASIC_BURST_FRAMES) {
+    uint16_t frames = ((count - start) < ASIC_BURST_FRAMES) ? (count - start) : ASIC_BURST_FRAMES;
+    for (uint16_t i = 0; i < frames; i++) {
+      tx[i] = encode_frame(address, regs[start + i], kSpiOpRead, 0);
+    }
+    if (kAsiceSuccess != transfer_blocking(chain, tx, rx, frames)) {
+      return kAsiceERR;
+    }
+
+    for (uint16_t i = 0; i < frames; i++) {
+      data[start + i] = (uint16_t)(rx[i] & 0xFFFF);
+      shadow_store(chain, address, regs[start + i], data[start + i]);
+    }
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Read one register from every asic in a mask as one transfer
+ *
+ * @param chain [in] Asic chain
+ * @param address_mask [in] Bit n set for asic address n
+ * @param reg [in] Asic register
+ * @param data [out] ASIC_MAX_DEVICES values indexed by address, others left unchanged
+ * @return asicState
+ */
+asicState asic_chain_read_each(asic_chain* chain, uint8_t address_mask, asicReg reg,
+                               uint16_t* data) {
+  if ((NULL == data) || (0 == address_mask)) {
+    return kAsiceERR;
+  }
+
+  uint32_t tx[ASIC_MAX_DEVICES];
+  uint32_t rx[ASIC_MAX_DEVICES];
+  uint16_t frames = 0;
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if (0 != (address_mask & (1 << address))) {
+      tx[frames++] = encode_frame(address, reg, kSpiOpRead, 0);
+    }
+  }
+  if (kAsiceSuccess != transfer_blocking(chain, tx, rx, frames)) {
+    return kAsiceERR;
+  }
+
+  for (uint16_t i = 0; i < frames; i++) {
+    uint32_t address = tx[i] >> 26;
+    data[address] = (uint16_t)(rx[i] & 0xFFFF);
+    shadow_store(chain, address, reg, data[address]);
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Build a register frame for asic_chain_transfer_frames
+ *
+ * @param address [in] Asic address
+ * @param reg [in] Asic register
+ * @param read [in] Read rather than write
+ * @param data [in] Write data, ignored for reads
+ * @return uint32_t frame
+ */
+uint32_t asic_frame_encode(uint32_t address, asicReg reg, bool read, uint16_t data) {
+  return read ? encode_frame(address, reg, kSpiOpRead, 0)
+              : encode_frame(address, reg, kSpiOpWrite, data);
+}
+
+/**
+ * @brief Replace the data field of encoded frames, the headers are kept
+ *
+ * @param frames [in/out] Frames from asic_frame_encode or ASIC_FRAME_HEADER
+ * @param data [in] New data, one value per frame
+ * @param count [in] Number of frames
+ */
+void asic_frames_patch(uint32_t* frames, const uint16_t* data, uint16_t count) {
+  for (uint16_t i = 0; i < count; i++) {
+    frames[i] = ASIC_FRAME_PATCH(frames[i], data[i]);
+  }
+}
+
+/**
+ * @brief Send already encoded read and write frames as one transfer and wait for them
+ *
+ * Frames may address any asic, the current address and broadcast mask are not used.
+ *
+ * @param chain [in] Asic chain
+ * @param tx [in] Frames from asic_frame_encode
+ * @param rx [out] Received frames, read data in 15:0, NULL if not needed
+ * @param count [in] Number of frames
+ * @return asicState
+ */
+asicState asic_chain_transfer_frames(asic_chain* chain, const uint32_t* tx, uint32_t* rx,
+                                     uint16_t count) {
+  if ((NULL == tx) || (0 == count)) {
+    return kAsiceERR;
+  }
+  if (kAsiceSuccess != transfer_blocking(chain, tx, rx, count)) {
+    return kAsiceERR;
+  }
+
+  for (uint16_t i = 0; i < count; i++) {
+    uint32_t address = tx[i] >> 26;
+    asicReg reg = (asicReg)((tx[i] >> 18) & 0xFF);
+    if (kSpiOpWrite == ((tx[i] >> 16) & 0x3)) {
+      shadow_store(chain, address, reg, (uint16_t)(tx[i] & 0xFFFF));
+    } else if (NULL != rx) {
+      shadow_store(chain, address, reg, (uint16_t)(rx[i] & 0xFFFF));
+    }
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Start a frame submit. The bus must already be locked.
+ *
+ * @param chain [in] Asic chain
+ * @param frames [in] Encoded frames
+ * @param count [in] Number of frames
+ * @param request [in/out] Request handle
+ * @return asicState
+ */
+static asicState submit_frames(asic_chain* chain, const uint32_t* frames, uint16_t count,
+                               asic_request* request) {
+  /* The transfer and its callback may finish before transfer_start returns */
+  shadow_frames(chain, frames, count, true);
+  if (kAsiceSuccess != transfer_start(chain, frames, NULL, count, 1, request)) {
+    shadow_frames(chain, frames, count, false);
+    request->state = kAsicRequest_Error;
+    return kAsiceERR;
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Hand already encoded write frames to the driver without waiting for them
+ *
+ * The driver clocks the frames straight out of the caller's buffer, nothing is copied or
+ * encoded, so keep the buffer (e.g. in DMA capable memory) unchanged until the request
+ * completes. Only blocks while a previous transfer holds the bus. Retransmission doesn't apply,
+ * and without a register shadow the frames aren't looked at at all. Read frames are sent but
+ * their data is not returned.
+ *
+ * @param chain [in] Asic chain
+ * @param frames [in] Write frames from asic_frame_encode or ASIC_FRAME_HEADER
+ * @param count [in] Number of frames
+ * @param request [in/out] Request handle, completed from the SPI interrupt
+ * @return asicState
+ */
+asicState asic_chain_submit_frames(asic_chain* chain, const uint32_t* frames, uint16_t count,
+                                   asic_request* request) {
+  if ((NULL == frames) || (0 == count) || (NULL == request)) {
+    return kAsiceERR;
+  }
+
+  request->data = NULL;
+  request->state = kAsicRequest_Pending;
+  lock(chain);
+  return submit_frames(chain, frames, count, request);
+}
+
+/**
+ * @brief asic_chain_submit_frames for interrupt context, fails instead of waiting for the bus
+ *
+ * With a semaphore the chain needs tryLockSem, lockSem is never called.
+ *
+ * @param chain [in] Asic chain
+ * @param frames [in] Write frames from asic_frame_encode or ASIC_FRAME_HEADER
+ * @param count [in] Number of frames
+ * @param request [in/out] Request handle, left kAsicRequest_Idle if the bus was held
+ * @return asicState
+ */
+asicState asic_chain_try_submit_frames(asic_chain* chain, const uint32_t* frames,
+                                       uint16_t count, asic_request* request) {
+  if ((NULL == frames) || (0 == count) || (NULL == request)) {
+    return kAsiceERR;
+  }
+  if (!try_lock(chain)) {
+    request->state = kAsicRequest_Idle;
+    return kAsiceERR;
+  }
+
+  request->data = NULL;
+  request->state = kAsicRequest_Pending;
+  return submit_frames(chain, frames, count, request);
+}
+
+/**
+ * @brief Write to asic register without waiting for the bus
+ *
+ * Only blocks while a previous transfer holds the bus. The request is
+ * completed from the SPI interrupt.
+ *
+ * @param chain [in] Asic chain
+ * @param reg [in] Asic register
+ * @param data [in] Value to write
+ * @param request [in/out] Request handle, must stay valid until completed
+ * @return asicState
+ */
+asicState asic_chain_write_async(asic_chain* chain, asicReg reg, uint16_t data,
+                                 asic_request* request) {
+  if (NULL == request) {
+    return kAsiceERR;
+  }
+
+  request->frame = encode_frame(chain->address, reg, kSpiOpWrite, data);
+  request->data = NULL;
+  request->state = kAsicRequest_Pending;
+  lock(chain);
+  /* The transfer and its callback may finish before transfer_start returns */
+  shadow_store(chain, chain->address, reg, data);
+  if (kAsiceSuccess != transfer_start(chain, &request->frame, NULL, 1, 1, request)) {
+    shadow_forget(chain, chain->address, reg);
+    request->state = kAsicRequest_Error;
+    return kAsiceERR;
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Read from asic register without waiting for the bus
+ *
+ * Only blocks while a previous transfer holds the bus. data is filled in
+ * from the SPI interrupt before the request is completed.
+ *
+ * @param chain [in] Asic chain
+ * @param reg [in] Asic register
+ * @param data [out] Caller owned destination, must stay valid until completed
+ * @param request [in/out] Request handle, must stay valid until completed
+ * @return asicState
+ */
+asicState asic_chain_read_async(asic_chain* chain, asicReg reg, uint16_t* data,
+                                asic_request* request) {
+  if ((NULL == request) || (NULL == data)) {
+    return kAsiceERR;
+  }
+
+  request->frame = encode_frame(chain->address, reg, kSpiOpRead, 0);
+  request->data = data;
+  request->state = kAsicRequest_Pending;
+  lock(chain);
+  if (kAsiceSuccess != transfer_start(chain, &request->frame, &request->read_data, 1, 1, request)) {
+    request->state = kAsicRequest_Error;
+    return kAsiceERR;
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Has an asynchronous request finished?
+ *
+ * @param request [in] Request handle
+ * @return true completed, check state for the result
+ * @return false still on the bus
+ */
+bool asic_request_done(const asic_request* request) {
+  return (kAsicRequest_Pending != request->state);
+}
+
+/**
+ * @brief Start a batch of register writes
+ *
+ * @param chain [in] Asic chain the batch is sent on
+ * @param batch [in/out] Batch handle
+ * @param frames [in] Frame storage, one entry per queued write
+ * @param capacity [in] Number of entries in frames
+ * @return asicState
+ */
+asicState asic_chain_batch_begin(asic_chain* chain, asic_batch* batch, uint32_t* frames,
+                                 uint16_t capacity) {
+  if ((NULL == chain) || (NULL == batch) || (NULL == frames) || (0 == capacity)) {
+    return kAsiceERR;
+  }
+
+  batch->chain = chain;
+  batch->frames = frames;
+  batch->capacity = capacity;
+  batch->count = 0;
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Queue a register write on a given asic
+ *
+ * A full batch is submitted before the write is queued.
+ *
+ * @param batch [in/out] Batch handle
+ * @param address [in] Asic address
+ * @param reg [in] Asic register
+ * @param data [in] Value to write
+ * @return asicState
+ */
+asicState asic_batch_write_to(asic_batch* batch, uint32_t address, asicReg reg, uint16_t data) {
+  if ((batch->count >= batch->capacity) && (kAsiceSuccess != asic_batch_submit(batch))) {
+    return kAsiceERR;
+  }
+
+  batch->frames[batch->count++] = encode_frame(address, reg, kSpiOpWrite, data);
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Queue a register write on the addressed asic(s)
+ *
+ * @param batch [in/out] Batch handle
+ * @param reg [in] Asic register
+ * @param data [in] Value to write
+ * @return asicState
+ */
+asicState asic_batch_write(asic_batch* batch, asicReg reg, uint16_t data) {
+  asic_chain* chain = batch->chain;
+  if (0 == chain->broadcast_mask) {
+    return asic_batch_write_to(batch, chain->address, reg, data);
+  }
+
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if ((0 != (chain->broadcast_mask & (1 << address))) &&
+        (kAsiceSuccess != asic_batch_write_to(batch, address, reg, data))) {
+      return kAsiceERR;
+    }
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Send every queued write and wait for completion
+ *
+ * The bus is locked once for the whole batch and frames are chained from the
+ * SPI interrupt. The batch is empty afterwards and can be reused. With
+ * retransmission enabled the batch is checked once after sending and only
+ * corrupted writes are sent again.
+ *
+ * @param batch [in/out] Batch handle
+ * @return asicState
+ */
+asicState asic_batch_submit(asic_batch* batch) {
+  asic_chain* chain = batch->chain;
+  uint16_t count = batch->count;
+  batch->count = 0;
+  if (0 == count) {
+    return kAsiceSuccess;
+  }
+
+  lock(chain);
+  if ((kAsiceSuccess != transfer_start(chain, batch->frames, NULL, count, 1, NULL)) ||
+      (kAsiceSuccess != transfer_wait(chain))) {
+    return kAsiceERR;
+  }
+
+  for (uint16_t i = 0; i < count; i++) {
+    uint32_t frame = batch->frames[i];
+    shadow_store(chain, frame >> 26, (asicReg)((frame >> 18) & 0xFF), (uint16_t)(frame & 0xFFFF));
+  }
+  return frames_check(chain, batch->frames, count);
+}
+
+/**
+ * @brief Send the queued writes several times over as one transfer
+ *
+ * For strobe sequences such as ADC sync pulses, the frames are only stored once.
+ *
+ * @param batch [in/out] Batch handle
+ * @param repeat [in] Times the queued writes are sent
+ * @return asicState
+ */
+asicState asic_batch_submit_repeat(asic_batch* batch, uint16_t repeat) {
+  asic_chain* chain = batch->chain;
+  uint16_t count = batch->count;
+  batch->count = 0;
+  if ((0 == count) || (0 == repeat)) {
+    return kAsiceSuccess;
+  }
+  if (((uint32_t)count * repeat) > UINT16_MAX) {
+    return kAsiceERR;
+  }
+
+  lock(chain);
+  if ((kAsiceSuccess != transfer_start(chain, batch->frames, NULL, count, repeat, NULL)) ||
+      (kAsiceSuccess != transfer_wait(chain))) {
+    return kAsiceERR;
+  }
+
+  for (uint16_t i = 0; i < count; i++) {
+    uint32_t frame = batch->frames[i];
+    shadow_store(chain, frame >> 26, (asicReg)((frame >> 18) & 0xFF), (uint16_t)(frame & 0xFFFF));
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Send every queued write without waiting for completion
+ *
+ * Only blocks while a previous transfer holds the bus. The frames must stay
+ * valid, and the batch must not be reused, until the request completes.
+ *
+ * @param batch [in/out] Batch handle
+ * @param request [in/out] Request handle, completed from the SPI interrupt
+ * @return asicState
+ */
+asicState asic_batch_submit_async(asic_batch* batch, asic_request* request) {
+  asic_chain* chain = batch->chain;
+  uint16_t count = batch->count;
+  if ((NULL == request) || (0 == count)) {
+    return kAsiceERR;
+  }
+
+  batch->count = 0;
+  request->data = NULL;
+  request->state = kAsicRequest_Pending;
+  lock(chain);
+  /* The transfer and its callback may finish before transfer_start returns */
+  shadow_frames(chain, batch->frames, count, true);
+  if (kAsiceSuccess != transfer_start(chain, batch->frames, NULL, count, 1, request)) {
+    shadow_frames(chain, batch->frames, count, false);
+    request->state = kAsicRequest_Error;
+    return kAsiceERR;
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Read from asic register, using the register shadow where possible
+ *
+ * Only the non volatile bits are valid when the value comes from the shadow.
+ * Falls back to a bus read if the shadow is disabled, the register is
+ * volatile or it hasn't been written/read since the last invalidate.
+ *
+ * @param chain [in] Asic chain
+ * @param reg [in] Asic register
+ * @param data [in/out] data pointer
+ * @return asicState
+ */
+asicState asic_chain_read_cached(asic_chain* chain, asicReg reg, uint16_t* data) {
+  asic_shadow* shadow = chain->spi.shadow;
+  if ((NULL != shadow) && (0xFFFF != shadow_volatile_bits(reg))) {
+    uint32_t device = read_address(chain) & (ASIC_MAX_DEVICES - 1);
+    uint32_t index = (uint32_t)reg & (ASIC_MAX_REGS - 1);
+    if (0 != (shadow->valid[device][index / 8] & (1 << (index % 8)))) {
+      *data = shadow->value[device][index];
+      return kAsiceSuccess;
+    }
+  }
+
+  return asic_chain_read(chain, reg, data);
+}
+
+/**
+ * @brief Mark every register of every asic as unknown
+ *
+ * Call after anything that changes asic registers behind the driver's back
+ * (power cycle, reset line, another bus master).
+ *
+ * @param chain [in] Asic chain
+ */
+void asic_chain_shadow_invalidate(asic_chain* chain) {
+  if ((NULL == chain) || (NULL == chain->spi.shadow)) {
+    return;
+  }
+  memset(chain->spi.shadow->valid, 0, sizeof(chain->spi.shadow->valid));
+}
+
+/**
+ * @brief Last value written to or read from a register, without using the bus
+ *
+ * @param chain [in] Asic chain
+ * @param address [in] Asic address
+ * @param reg [in] Asic register
+ * @param data [out] Non volatile bits of the register
+ * @return true value known
+ * @return false shadow disabled, register volatile or not seen since the last invalidate
+ */
+bool asic_chain_shadow_get(const asic_chain* chain, uint32_t address, asicReg reg,
+                           uint16_t* data) {
+  const asic_shadow* shadow = chain->spi.shadow;
+  uint32_t device = address & (ASIC_MAX_DEVICES - 1);
+  uint32_t index = (uint32_t)reg & (ASIC_MAX_REGS - 1);
+  if ((NULL == shadow) || (0 == (shadow->valid[device][index / 8] & (1 << (index % 8))))) {
+    return false;
+  }
+
+  *data = shadow->value[device][index];
+  return true;
+}
+
+/**
+ * @brief Refresh the shadow of the addressed asic from the bus
+ *
+ * Re-reads every register currently held in the shadow.
+ *
+ * @param chain [in] Asic chain
+ * @return asicState
+ */
+asicState asic_chain_shadow_resync(asic_chain* chain) {
+  asic_shadow* shadow = chain->spi.shadow;
+  if (NULL == shadow) {
+    return kAsiceERR;
+  }
+
+  asicReg regs[ASIC_BURST_FRAMES];
+  uint16_t data[ASIC_BURST_FRAMES];
+  uint16_t count = 0;
+  uint32_t device = chain->address & (ASIC_MAX_DEVICES - 1);
+  for (uint32_t index = 0; index < ASIC_MAX_REGS; index++) {
+    if (0 != (shadow->valid[device][index / 8] & (1 << (index % 8)))) {
+      regs[count++] = (asicReg)index;
+    }
+
+    bool flush = (ASIC_BURST_FRAMES == count) || ((ASIC_MAX_REGS - 1) == index);
+    if (flush && (0 != count)) {
+      if (kAsiceSuccess != asic_chain_read_burst(chain, regs, count, data)) {
+        return kAsiceERR;
+      }
+      count = 0;
+    }
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Is a table entry overwritten by a later entry for the same register?
+ *
+ * @param table [in] Register writes
+ * @param count [in] Number of entries
+ * @param entry [in] Entry to check
+ * @return true later entry for the same register
+ * @return false last write of the register
+ */
+static bool table_superseded(const asic_reg_write* table, uint16_t count, uint16_t entry) {
+  for (uint16_t i = entry + 1; i < count; i++) {
+    if (table[i].reg == table[entry].reg) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Read a table back from one asic and compare it with what was written
+ *
+ * Volatile bits, and registers written again later in the table, are not compared.
+ *
+ * @param chain [in] Asic chain
+ * @param address [in] Asic address
+ * @param table [in] Register writes
+ * @param count [in] Number of entries
+ * @return asicState
+ */
+static asicState table_verify(asic_chain* chain, uint32_t address, const asic_reg_write* table,
+                              uint16_t count) {
+  uint32_t tx[ASIC_BURST_FRAMES];
+  uint32_t rx[ASIC_BURST_FRAMES];
+  uint16_t entries[ASIC_BURST_FRAMES];
+  uint16_t entry = 0;
+  while (entry < count) {
+    uint16_t frames = 0;
+    for (; (entry < count) && (frames < ASIC_BURST_FRAMES); entry++) {
+      if ((0xFFFF != shadow_volatile_bits(table[entry].reg)) &&
+          !table_superseded(table, count, entry)) {
+        entries[frames] = entry;
+        tx[frames++] = encode_frame(address, table[entry].reg, kSpiOpRead, 0);
+      }
+    }
+    if (0 == frames) {
+      continue;
+    }
+
+    if (kAsiceSuccess != transfer_blocking(chain, tx, rx, frames)) {
+      return kAsiceERR;
+    }
+
+    for (uint16_t i = 0; i < frames; i++) {
+      const asic_reg_write* write = &table[entries[i]];
+      uint16_t mask = ~shadow_volatile_bits(write->reg);
+      if (0 != ((rx[i] ^ write->value) & mask)) {
+        return kAsiceERR;
+      }
+    }
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Stream a table of register writes to the chain
+ *
+ * Writes go out ASIC_BURST_FRAMES frames per transfer, fanned out over the broadcast mask if
+ * one is set. Tables are usually const so they live in flash, and boards can supply their own.
+ *
+ * @param chain [in] Asic chain
+ * @param table [in] Register writes, in order
+ * @param count [in] Number of entries
+ * @param verify [in] Read every addressed asic back and compare
+ * @return asicState
+ */
+asicState asic_chain_write_table(asic_chain* chain, const asic_reg_write* table, uint16_t count,
+                                 bool verify) {
+  if (NULL == table) {
+    return kAsiceERR;
+  }
+
+  uint32_t frames[ASIC_BURST_FRAMES];
+  asic_batch batch;
+  if (kAsiceSuccess != asic_chain_batch_begin(chain, &batch, frames, ASIC_BURST_FRAMES)) {
+    return kAsiceERR;
+  }
+  for (uint16_t i = 0; i < count; i++) {
+    if (kAsiceSuccess != asic_batch_write(&batch, table[i].reg, table[i].value)) {
+      return kAsiceERR;
+    }
+  }
+  if (kAsiceSuccess != asic_batch_submit(&batch)) {
+    return kAsiceERR;
+  }
+
+  if (!verify) {
+    return kAsiceSuccess;
+  }
+
+  uint8_t mask = (0 != chain->broadcast_mask) ? chain->broadcast_mask : (1 << chain->address);
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if ((0 != (mask & (1 << address))) &&
+        (kAsiceSuccess != table_verify(chain, address, table, count))) {
+      return kAsiceERR;
+    }
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Check blocking writes and batches for CRC errors and resend corrupted writes
+ *
+ * crc_error should read a host pin wired to an asic GPIO routed to kGPIOOutsel_CRCError,
+ * latched in hardware or by an edge interrupt, and clear the latch. Without it every checked
+ * write is read back, one burst per batch. Repeated and asynchronous batches aren't checked.
+ *
+ * @param chain [in] Asic chain
+ * @param crc_error [in] Optional, true if a CRC error was raised since the last call
+ * @param retries [in] Retransmissions per batch, 0 disables checking
+ * @return asicState
+ */
+asicState asic_chain_set_retransmit(asic_chain* chain, bool (*crc_error)(void), uint8_t retries) {
+  if (NULL == chain) {
+    return kAsiceERR;
+  }
+
+  chain->crc_error = crc_error;
+  chain->retries = retries;
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Copy the retransmission counters, e.g. to spot a degrading link
+ *
+ * @param chain [in] Asic chain
+ * @param snapshot [out] Counters
+ */
+void asic_chain_retry_snapshot(const asic_chain* chain, asic_retry_stats* snapshot) {
+  *snapshot = chain->retry;
+}
+
+#ifdef ASIC_INSTRUMENTATION
+/**
+ * @brief Set the timestamp hook used for lock wait and latency
+ *
+ * @param chain [in] Asic chain
+ * @param timestamp [in] Free running counter, NULL to stop timing
+ */
+void asic_chain_stats_set_clock(asic_chain* chain, uint32_t (*timestamp)(void)) {
+  chain->stats.timestamp = timestamp;
+}
+
+/**
+ * @brief Copy the chain's counters
+ *
+ * Counters updated from the SPI interrupt while copying may be one transfer apart.
+ *
+ * @param chain [in] Asic chain
+ * @param snapshot [out] Counters
+ */
+void asic_chain_stats_snapshot(const asic_chain* chain, asic_stats* snapshot) {
+  memcpy(snapshot, &chain->stats, sizeof(*snapshot));
+}
+
+/**
+ * @brief Clear the chain's counters, the timestamp hook is kept
+ *
+ * @param chain [in] Asic chain
+ */
+void asic_chain_stats_reset(asic_chain* chain) {
+  uint32_t (*timestamp)(void) = chain->stats.timestamp;
+  memset(&chain->stats, 0, sizeof(chain->stats));
+  chain->stats.timestamp = timestamp;
+}
+#endif
+
+/**
+ * @brief Initialise the SPI peripheral of the default chain
+ *
+ * @param spi_struct [in] SPI handle
+ * @param callback [in] Interrupt callback
+ * @return asicState
+ */
+asicState asic_initSPI(asic_spi_struct* spi_struct, void (*callback)(uint32_t event)) {
+  return asic_chain_init(&default_chain, spi_struct, callback);
+}
+
+/**
+ * @brief Change the SPI clock of the default chain
+ *
+ * @param speed [in] Bus speed in Hz
+ * @return asicState
+ */
+asicState asic_set_speed(uint32_t speed) {
+  return asic_chain_set_speed(&default_chain, speed);
+}
+
+/**
+ * @brief Set address of asic on the default chain
+ *
+ * @param address [in] Asic address
+ * @return asicState
+ */
+asicState asic_setAddress(uint32_t address) {
+  return asic_chain_set_address(&default_chain, address);
+}
+
+asicState asic_write(asicReg reg, uint16_t data) {
+  return asic_chain_write(&default_chain, reg, data);
+}
+
+asicState asic_read(asicReg reg, uint16_t* data) {
+  return asic_chain_read(&default_chain, reg, data);
+}
+
+asicState asic_read_burst(const asicReg* regs, uint16_t count, uint16_t* data) {
+  return asic_chain_read_burst(&default_chain, regs, count, data);
+}
+
+asicState asic_read_each(uint8_t address_mask, asicReg reg, uint16_t* data) {
+  return asic_chain_read_each(&default_chain, address_mask, reg, data);
+}
+
+asicState asic_transfer_frames(const uint32_t* tx, uint32_t* rx, uint16_t count) {
+  return asic_chain_transfer_frames(&default_chain, tx, rx, count);
+}
+
+asicState asic_submit_frames(const uint32_t* frames, uint16_t count, asic_request* request) {
+  return asic_chain_submit_frames(&default_chain, frames, count, request);
+}
+
+asicState asic_try_submit_frames(const uint32_t* frames, uint16_t count, asic_request* request) {
+  return asic_chain_try_submit_frames(&default_chain, frames, count, request);
+}
+
+asicState asic_broadcast_begin(uint8_t address_mask) {
+  return asic_chain_broadcast_begin(&default_chain, address_mask);
+}
+
+asicState asic_broadcast_end(void) {
+  return asic_chain_broadcast_end(&default_chain);
+}
+
+asicState asic_broadcast_write(uint8_t address_mask, asicReg reg, uint16_t data) {
+  return asic_chain_broadcast_write(&default_chain, address_mask, reg, data);
+}
+
+asicState asic_write_async(asicReg reg, uint16_t data, asic_request* request) {
+  return asic_chain_write_async(&default_chain, reg, data, request);
+}
+
+asicState asic_read_async(asicReg reg, uint16_t* data, asic_request* request) {
+  return asic_chain_read_async(&default_chain, reg, data, request);
+}
+
+asicState asic_read_cached(asicReg reg, uint16_t* data) {
+  return asic_chain_read_cached(&default_chain, reg, data);
+}
+
+void asic_shadow_invalidate(void) {
+  asic_chain_shadow_invalidate(&default_chain);
+}
+
+asicState asic_shadow_resync(void) {
+  return asic_chain_shadow_resync(&default_chain);
+}
+
+asicState asic_batch_begin(asic_batch* batch, uint32_t* frames, uint16_t capacity) {
+  return asic_chain_batch_begin(&default_chain, batch, frames, capacity);
+}
+
+asicState asic_write_table(const asic_reg_write* table, uint16_t count, bool verify) {
+  return asic_chain_write_table(&default_chain, table, count, verify);
+}
+
+asicState asic_set_retransmit(bool (*crc_error)(void), uint8_t retries) {
+  return asic_chain_set_retransmit(&default_chain, crc_error, retries);
+}
+
+void asic_retry_snapshot(asic_retry_stats* snapshot) {
+  asic_chain_retry_snapshot(&default_chain, snapshot);
+}
+
+#ifdef ASIC_INSTRUMENTATION
+void asic_stats_set_clock(uint32_t (*timestamp)(void)) {
+  asic_chain_stats_set_clock(&default_chain, timestamp);
+}
+
+void asic_stats_snapshot(asic_stats* snapshot) {
+  asic_chain_stats_snapshot(&default_chain, snapshot);
+}
+
+void asic_stats_reset(void) {
+  asic_chain_stats_reset(&default_chain);
+}
+#endif
@@ -0,0 +1,201 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "asic_common.h"
+#include "asic_pwm.h"
+#include "asic_regs.h"
+#include "asic_spi.h"
+#include "asic_stage.h"
+
+/* Frames per transfer of a commit */
+#define ASIC_STAGE_FRAMES 64
+
+/**
+ * @brief Is a staged register waiting to be committed?
+ *
+ * @param stage [in] Stage handle
+ * @param address [in] Asic address
+ * @param index [in] Register index
+ * @return true dirty
+ * @return false same as the committed value
+ */
+static bool stage_dirty(const asic_stage* stage, uint32_t address, uint32_t index) {
+  return 0 != (stage->dirty[address][index / 8] & (1 << (index % 8)));
+}
+
+/**
+ * @brief PWM_CONFIG value to sync an asic with
+ *
+ * @param stage [in] Stage handle
+ * @param address [in] Asic address
+ * @param config [out] PWM_CONFIG with the sync bit set
+ * @return asicState
+ */
+static asicState stage_sync_config(const asic_stage* stage, uint32_t address, uint16_t* config) {
+  uint16_t data[ASIC_MAX_DEVICES];
+  if (stage_dirty(stage, address, REG_PWM_CONFIG)) {
+    data[address] = stage->value[address][REG_PWM_CONFIG];
+  } else if (!asic_chain_shadow_get(stage->chain, address, REG_PWM_CONFIG, &data[address]) &&
+             (kAsiceSuccess !=
+              asic_chain_read_each(stage->chain, 1 << address, REG_PWM_CONFIG, data))) {
+    return kAsiceERR;
+  }
+
+  *config = data[address] | ASIC_PWM_SYNC;
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Start staging writes to a chain
+ *
+ * The chain needs a register shadow, it holds the committed state.
+ *
+ * @param chain [in] Asic chain
+ * @param stage [out] Stage handle
+ * @return asicState
+ */
+asicState asic_chain_stage_init(asic_chain* chain, asic_stage* stage) {
+  if ((NULL == chain) || (NULL == stage) || (NULL == chain->spi.shadow)) {
+    return kAsiceERR;
+  }
+
+  memset(stage, 0, sizeof(*stage));
+  stage->chain = chain;
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Stage a register write, nothing goes on the bus until the commit
+ *
+ * A write of the committed value cancels an earlier staged change of the register.
+ *
+ * @param stage [in/out] Stage handle
+ * @param address [in] Asic address
+ * @param reg [in] Asic register
+ * @param data [in] Value to write
+ */
+void asic_stage_write(asic_stage* stage, uint32_t address, asicReg reg, uint16_t data) {
+  uint32_t device = address & (ASIC_MAX_DEVICES - 1);
+  uint32_t index = (uint32_t)reg & (ASIC_MAX_REGS - 1);
+  uint8_t bit = (uint8_t)(1 << (index % 8));
+  uint16_t committed;
+  stage->value[device][index] = data;
+  stage->written |= (uint8_t)(1 << device);
+  stage->writes++;
+  if (asic_chain_shadow_get(stage->chain, device, reg, &committed) && (committed == data)) {
+    stage->dirty[device][index / 8] &= (uint8_t)~bit;
+  } else {
+    stage->dirty[device][index / 8] |= bit;
+  }
+}
+
+/**
+ * @brief Send the staged changes, then one PWM sync per asic changed
+ *
+ * PWM duty and delay only take effect at the sync, so the asics switch to the whole staged set
+ * at once. Every sync goes out in the final transfer, after all the other writes. An asic's
+ * writes share a transfer unless there are more than a transfer holds. A staged PWM_CONFIG
+ * goes out with the sync. The sync values are known before anything is sent, and if the commit
+ * fails every change stays staged and is sent again by the next commit.
+ *
+ * @param stage [in/out] Stage handle
+ * @param saved [out] Optional, frames saved against writing every staged value and syncing
+ * every asic written
+ * @return asicState
+ */
+asicState asic_stage_commit(asic_stage* stage, uint32_t* saved) {
+  uint16_t config[ASIC_MAX_DEVICES];
+  uint16_t writes[ASIC_MAX_DEVICES] = {0};
+  uint8_t changed = 0;
+  uint32_t syncs = 0;
+  uint32_t naive = stage->writes;
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if (0 == (stage->written & (1 << address))) {
+      continue;
+    }
+
+    naive++;
+    for (uint32_t index = 0; index < ASIC_MAX_REGS; index++) {
+      if ((REG_PWM_CONFIG != index) && stage_dirty(stage, address, index)) {
+        writes[address]++;
+      }
+    }
+    if ((0 != writes[address]) || stage_dirty(stage, address, REG_PWM_CONFIG)) {
+      if (kAsiceSuccess != stage_sync_config(stage, address, &config[address])) {
+        return kAsiceERR;
+      }
+      changed |= (uint8_t)(1 << address);
+      syncs++;
+    }
+  }
+
+  uint32_t frames[ASIC_STAGE_FRAMES];
+  asic_batch batch;
+  if (kAsiceSuccess != asic_chain_batch_begin(stage->chain, &batch, frames, ASIC_STAGE_FRAMES)) {
+    return kAsiceERR;
+  }
+
+  uint32_t sent = syncs;
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if (0 == (changed & (1 << address))) {
+      continue;
+    }
+    if (((batch.count + writes[address]) > ASIC_STAGE_FRAMES) &&
+        (kAsiceSuccess != asic_batch_submit(&batch))) {
+      return kAsiceERR;
+    }
+
+    for (uint32_t index = 0; index < ASIC_MAX_REGS; index++) {
+      if ((REG_PWM_CONFIG == index) || !stage_dirty(stage, address, index)) {
+        continue;
+      }
+      if (kAsiceSuccess !=
+          asic_batch_write_to(&batch, address, (asicReg)index, stage->value[address][index])) {
+        return kAsiceERR;
+      }
+    }
+    sent += writes[address];
+  }
+
+  if (((batch.count + syncs) > ASIC_STAGE_FRAMES) &&
+      (kAsiceSuccess != asic_batch_submit(&batch))) {
+    return kAsiceERR;
+  }
+  for (uint32_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if ((0 != (changed & (1 << address))) &&
+        (kAsiceSuccess != asic_batch_write_to(&batch, address, REG_PWM_CONFIG, config[address]))) {
+      return kAsiceERR;
+    }
+  }
+  if (kAsiceSuccess != asic_batch_submit(&batch)) {
+    return kAsiceERR;
+  }
+
+  memset(stage->dirty, 0, sizeof(stage->dirty));
+  stage->written = 0;
+  stage->writes = 0;
+  stage->frames += sent;
+  stage->saved += naive - sent;
+  if (NULL != saved) {
+    *saved = naive - sent;
+  }
+  return kAsiceSuccess;
+}
+
+/**
+ * @brief Drop every staged change
+ *
+ * @param stage [in/out] Stage handle
+ */
+void asic_stage_discard(asic_stage* stage) {
+  memset(stage->dirty, 0, sizeof(stage->dirty));
+  stage->written = 0;
+  stage->writes = 0;
+}
+
+/* Default chain */
+
+asicState asic_stage_init(asic_stage* stage) {
+  return asic_chain_stage_init(asic_default_chain(), stage);
+}
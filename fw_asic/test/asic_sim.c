@@ -0,0 +1,319 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Driver_SPI.h"
+#include "asic_gpio.h"
+#include "asic_regs.h"
+#include "asic_sim.h"
+#include "asic_spi.h"
+
+asic_sim g_asic_sim;
+
+static const uint32_t kSimFrameBits = 29;
+static const uint32_t kSimDefaultSpeed = 15000000;  // Hz
+static const uint32_t kSimDefaultConversionFrames = 4;
+
+/* REG_ADC_STATE bits */
+static const uint16_t kSimAdcChannel = 0x7;
+static const uint16_t kSimAdcEn = 1 << 3;
+static const uint16_t kSimAdcDone = 1 << 4;
+static const uint16_t kSimAdcSync = 1 << 6;
+/* REG_PWM_CONFIG bits */
+static const uint16_t kSimPwmSync = 1 << 15;
+
+/**
+ * @brief Deliver a completion event, queued if the driver is already in its callback
+ */
+static void signal_complete(void) {
+  g_asic_sim.pending_events++;
+  if (g_asic_sim.in_callback) {
+    return;
+  }
+
+  g_asic_sim.in_callback = true;
+  while (0 < g_asic_sim.pending_events) {
+    g_asic_sim.pending_events--;
+    if (NULL != g_asic_sim.callback) {
+      g_asic_sim.callback(ARM_SPI_EVENT_TRANSFER_COMPLETE);
+    }
+  }
+  g_asic_sim.in_callback = false;
+}
+
+/**
+ * @brief Raise an edge on every enabled GPIO of an asic routed to an output
+ *
+ * @param address [in] Asic address
+ * @param source [in] GPIO output select
+ */
+static void gpio_edge(uint8_t address, GpioOutSel source) {
+  uint16_t outsel = g_asic_sim.regs[address][REG_GPIO_OUTSEL];
+  uint16_t oe = g_asic_sim.regs[address][REG_GPIO_OE];
+  for (uint8_t gpio = 0; gpio < 4; gpio++) {
+    if ((source == ((outsel >> (4 * gpio)) & 0xF)) && (oe & (1 << gpio)) &&
+        (NULL != g_asic_sim.gpio_edge)) {
+      g_asic_sim.gpio_edge(address, gpio);
+    }
+  }
+}
+
+/**
+ * @brief Advance ADC conversions by one frame time
+ */
+static void adc_tick(void) {
+  for (uint8_t address = 0; address < ASIC_MAX_DEVICES; address++) {
+    if ((0 == g_asic_sim.adc_countdown[address]) || (0 != --g_asic_sim.adc_countdown[address])) {
+      continue;
+    }
+
+    uint16_t* regs = g_asic_sim.regs[address];
+    uint16_t channel = regs[REG_ADC_STATE] & kSimAdcChannel;
+    uint16_t select = regs[REG_ADC_LOAD_SENSE];
+    regs[REG_ADC_VAL] = g_asic_sim.adc_input[address][channel];
+    if ((ASIC_SIM_LOAD_SENSE_CHANNEL == channel) && (0 != select) &&
+        (0 == (select & (select - 1)))) {
+      regs[REG_ADC_VAL] = g_asic_sim.load_sense[address][__builtin_ctz(select)];
+    }
+    regs[REG_ADC_STATE] |= kSimAdcDone;
+    if (NULL != g_asic_sim.adc_complete) {
+      g_asic_sim.adc_complete(address);
+    }
+  }
+}
+
+/**
+ * @brief Apply a register write to one asic
+ *
+ * @param address [in] Asic address
+ * @param reg [in] Register
+ * @param data [in] Written value
+ */
+static void register_write(uint8_t address, uint8_t reg, uint16_t data) {
+  uint16_t* regs = g_asic_sim.regs[address];
+  switch (reg) {
+    case REG_ADC_STATE:
+      if (data & kSimAdcSync) {
+        g_asic_sim.adc_syncs[address]++;
+        gpio_edge(address, kGPIOOutsel_ADCSyncToggle);
+      }
+      regs[reg] = (data & ~(kSimAdcEn | kSimAdcSync | kSimAdcDone)) | (regs[reg] & kSimAdcDone);
+      if (data & kSimAdcEn) {
+        regs[reg] &= ~kSimAdcDone;
+        g_asic_sim.adc_countdown[address] = g_asic_sim.adc_conversion_frames;
+        g_asic_sim.adc_conversions[address]++;
+      }
+      break;
+    case REG_PWM_CONFIG:
+      if (data & kSimPwmSync) {
+        g_asic_sim.pwm_syncs[address]++;
+      }
+      regs[reg] = data & ~kSimPwmSync;
+      break;
+    case REG_ADC_LOAD_SENSE:
+      if (0 != (data & (data - 1))) {
+        g_asic_sim.load_sense_faults++;
+      }
+      regs[reg] = data;
+      break;
+    case REG_SHORT_DETECT:
+      /* Write one to clear */
+      regs[reg] &= ~data;
+      break;
+    case REG_ADC_VAL:
+    case REG_GPIO_IN:
+      /* Read only */
+      break;
+    default:
+      regs[reg] = data;
+      break;
+  }
+}
+
+/**
+ * @brief Clock one frame through the chain
+ *
+ * @param frame [in] Frame sent by the host
+ * @return uint32_t Frame clocked back, read data in 15:0
+ */
+static uint32_t clock_frame(uint32_t frame) {
+  asic_sim_log_entry* entry = &g_asic_sim.log[g_asic_sim.frames % ASIC_SIM_LOG];
+  entry->frame = frame;
+  entry->cs = g_asic_sim.cs;
+  g_asic_sim.frames++;
+  uint32_t bus_speed = (0 != g_asic_sim.bus_speed) ? g_asic_sim.bus_speed : kSimDefaultSpeed;
+  g_asic_sim.elapsed_ns += ((uint64_t)kSimFrameBits * 1000000000u) / bus_speed;
+
+  /* Too fast for the link, or an injected error: a data bit is lost in both directions */
+  bool injected = false;
+  if (g_asic_sim.cs) {
+    injected = (0 != (g_asic_sim.corrupt & 1));
+    g_asic_sim.corrupt >>= 1;
+  }
+  g_asic_sim.crc_error =
+      injected || ((0 != g_asic_sim.max_bus_speed) && (bus_speed > g_asic_sim.max_bus_speed));
+  if (g_asic_sim.crc_error) {
+    g_asic_sim.crc_errors++;
+    frame ^= 0x0001;
+  }
+
+  uint32_t response = frame;
+  if (!g_asic_sim.cs) {
+    g_asic_sim.reset = true;
+    g_asic_sim.reset_frames++;
+  } else if (!g_asic_sim.reset) {
+    g_asic_sim.protocol_errors++;
+  } else {
+    uint8_t address = (frame >> 26) & (ASIC_MAX_DEVICES - 1);
+    uint8_t reg = (frame >> 18) & (ASIC_MAX_REGS - 1);
+    uint32_t op = (frame >> 16) & 0x3;
+    g_asic_sim.reset = false;
+    g_asic_sim.register_frames++;
+    if (0 == op) {
+      register_write(address, reg, frame & 0xFFFF);
+    } else {
+      response = (frame & 0xFFFF0000) | g_asic_sim.regs[address][reg];
+    }
+    if (NULL != g_asic_sim.frame_hook) {
+      g_asic_sim.frame_hook(frame);
+    }
+  }
+
+  adc_tick();
+  return response;
+}
+
+static ARM_DRIVER_VERSION sim_get_version(void) {
+  ARM_DRIVER_VERSION version = {0x0200, 0x0100};
+  return version;
+}
+
+static ARM_SPI_CAPABILITIES sim_get_capabilities(void) {
+  ARM_SPI_CAPABILITIES capabilities = {0};
+  return capabilities;
+}
+
+static int32_t sim_initialize(ARM_SPI_SignalEvent_t cb_event) {
+  g_asic_sim.callback = cb_event;
+  return ARM_DRIVER_OK;
+}
+
+static int32_t sim_uninitialize(void) {
+  g_asic_sim.callback = NULL;
+  return ARM_DRIVER_OK;
+}
+
+static int32_t sim_power_control(ARM_POWER_STATE state) {
+  (void)state;
+  return ARM_DRIVER_OK;
+}
+
+static int32_t sim_transfer(const void* data_out, void* data_in, uint32_t num) {
+  if ((NULL == data_out) || (0 == num)) {
+    return ARM_DRIVER_ERROR_PARAMETER;
+  }
+
+  const uint32_t* tx = data_out;
+  uint32_t* rx = data_in;
+  g_asic_sim.last_tx = tx;
+  for (uint32_t i = 0; i < num; i++) {
+    uint32_t response = clock_frame(tx[i]);
+    if (NULL != rx) {
+      rx[i] = response;
+    }
+  }
+  signal_complete();
+  return ARM_DRIVER_OK;
+}
+
+static int32_t sim_send(const void* data, uint32_t num) {
+  return sim_transfer(data, NULL, num);
+}
+
+static int32_t sim_receive(void* data, uint32_t num) {
+  (void)data;
+  (void)num;
+  return ARM_DRIVER_ERROR_UNSUPPORTED;
+}
+
+static uint32_t sim_get_data_count(void) {
+  return 0;
+}
+
+static int32_t sim_control(uint32_t control, uint32_t arg) {
+  uint32_t mode = control & ARM_SPI_CONTROL_Msk;
+  if ((ARM_SPI_MODE_MASTER == mode) || (ARM_SPI_SET_BUS_SPEED == mode)) {
+    if (0 == arg) {
+      return ARM_DRIVER_ERROR_PARAMETER;
+    }
+    g_asic_sim.bus_speed = arg;
+  }
+  return ARM_DRIVER_OK;
+}
+
+static ARM_SPI_STATUS sim_get_status(void) {
+  ARM_SPI_STATUS status = {0};
+  return status;
+}
+
+ARM_DRIVER_SPI asic_sim_driver = {
+    sim_get_version,    sim_get_capabilities, sim_initialize, sim_uninitialize,
+    sim_power_control,  sim_send,             sim_receive,    sim_transfer,
+    sim_get_data_count, sim_control,          sim_get_status,
+};
+
+/**
+ * @brief Clear every asic and all counters, the driver callback is kept
+ */
+void asic_sim_reset(void) {
+  ARM_SPI_SignalEvent_t callback = g_asic_sim.callback;
+  uint32_t bus_speed = g_asic_sim.bus_speed;
+  memset(&g_asic_sim, 0, sizeof(g_asic_sim));
+  g_asic_sim.callback = callback;
+  g_asic_sim.bus_speed = (0 != bus_speed) ? bus_speed : kSimDefaultSpeed;
+  g_asic_sim.adc_conversion_frames = kSimDefaultConversionFrames;
+}
+
+/**
+ * @brief Assert chip select, for asic_spi_struct.setCS
+ */
+void asic_sim_set_cs(void) {
+  g_asic_sim.cs = true;
+}
+
+/**
+ * @brief Release chip select, for asic_spi_struct.clearCS
+ */
+void asic_sim_clear_cs(void) {
+  g_asic_sim.cs = false;
+}
+
+/**
+ * @brief Raise short detect flags on an asic, with an SC detect edge if none were set
+ *
+ * @param address [in] Asic address
+ * @param shorts [in] Bit n set for PWM channel n
+ */
+void asic_sim_inject_short(uint8_t address, uint16_t shorts) {
+  address &= (ASIC_MAX_DEVICES - 1);
+  uint16_t* detect = &g_asic_sim.regs[address][REG_SHORT_DETECT];
+  bool rising = (0 == *detect) && (0 != shorts);
+  *detect |= shorts;
+  if (rising) {
+    gpio_edge(address, kGPIOOutsel_SCDetect);
+  }
+}
+
+/**
+ * @brief Frame from the log
+ *
+ * @param age [in] 0 for the most recent frame
+ * @return const asic_sim_log_entry* NULL if the frame is no longer (or never was) logged
+ */
+const asic_sim_log_entry* asic_sim_log(uint32_t age) {
+  if ((age >= g_asic_sim.frames) || (age >= ASIC_SIM_LOG)) {
+    return NULL;
+  }
+  return &g_asic_sim.log[(g_asic_sim.frames - 1 - age) % ASIC_SIM_LOG];
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "Driver_SPI.h"
+#include "asic_spi.h"
+
+/* Frames kept in the simulator frame log */
+#define ASIC_SIM_LOG 256
+/* ADC channels per asic */
+#define ASIC_SIM_ADC_CHANNELS 8
+/* ADC channel reading the load sense block */
+#define ASIC_SIM_LOAD_SENSE_CHANNEL 3
+/* Transducers behind the load sense block */
+#define ASIC_SIM_LOAD_SENSE_INPUTS 16
+
+/**
+ * @brief One frame seen on the bus
+ */
+typedef struct {
+  uint32_t frame;
+  bool cs; /* Chip select asserted (false for reset frames) */
+} asic_sim_log_entry;
+
+/**
+ * @brief In memory model of a chain of asics behind an ARM_DRIVER_SPI
+ *
+ * Completion events are delivered before Send/Transfer returns. Events raised from inside the
+ * callback are queued and delivered by the outermost call, so long transfers don't recurse.
+ */
+typedef struct {
+  uint16_t regs[ASIC_MAX_DEVICES][ASIC_MAX_REGS];
+
+  /* ADC model */
+  uint16_t adc_input[ASIC_MAX_DEVICES][ASIC_SIM_ADC_CHANNELS];
+  uint32_t adc_conversion_frames; /* Frames on the bus before a conversion is done */
+  uint32_t adc_countdown[ASIC_MAX_DEVICES];
+  uint32_t adc_conversions[ASIC_MAX_DEVICES];
+  uint32_t adc_syncs[ASIC_MAX_DEVICES];
+  uint32_t pwm_syncs[ASIC_MAX_DEVICES];
+  /* Reading of the transducer selected by a one-hot REG_ADC_LOAD_SENSE */
+  uint16_t load_sense[ASIC_MAX_DEVICES][ASIC_SIM_LOAD_SENSE_INPUTS];
+  uint32_t load_sense_faults; /* REG_ADC_LOAD_SENSE writes with more than one bit set */
+  /* Optional, emulated GPIO edge on a pin routed to the ADC sync toggle or SC detect */
+  void (*gpio_edge)(uint8_t address, uint8_t gpio);
+  /* Optional, called when a conversion finishes, stands in for a host conversion timer */
+  void (*adc_complete)(uint8_t address);
+
+  /* Bus model */
+  ARM_SPI_SignalEvent_t callback;
+  bool cs;
+  bool reset; /* Reset frame seen since the last register frame */
+  uint32_t bus_speed;
+  uint32_t max_bus_speed; /* Frames clocked faster are corrupted, 0 for no limit */
+  bool crc_error;         /* CRC error flag, set by a corrupted frame, cleared by a good one */
+  uint32_t crc_errors;
+  uint32_t corrupt;    /* Bit n corrupts the nth register frame from now */
+  uint64_t elapsed_ns; /* Bus time of every frame sent so far */
+  uint32_t frames;
+  uint32_t reset_frames;
+  uint32_t register_frames;
+  uint32_t protocol_errors; /* Register frames without a reset frame before them */
+  const uint32_t* last_tx;  /* Buffer handed to the driver for the last frame */
+  /* Optional, called after each register frame, e.g. to raise an interrupt mid transfer */
+  void (*frame_hook)(uint32_t frame);
+  uint32_t pending_events;
+  bool in_callback;
+  asic_sim_log_entry log[ASIC_SIM_LOG];
+} asic_sim;
+
+extern asic_sim g_asic_sim;
+extern ARM_DRIVER_SPI asic_sim_driver;
+
+void asic_sim_reset(void);
+void asic_sim_set_cs(void);
+void asic_sim_clear_cs(void);
+void asic_sim_inject_short(uint8_t address, uint16_t shorts);
+const asic_sim_log_entry* asic_sim_log(uint32_t age);
\ No newline at end of file
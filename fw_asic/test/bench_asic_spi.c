@@ -0,0 +1,180 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "asic_adc.h"
+#include "asic_gpio.h"
+#include "asic_pwm.h"
+#include "asic_short.h"
+#include "asic_sim.h"
+#include "asic_spi.h"
+
+/*
+ * Bus cost of each driver operation against the simulator.
+ *
+ *   bench_asic_spi              CSV for every operation
+ *   bench_asic_spi <op> <max>   CSV for one operation, fails if it takes more than max frames
+ */
+
+static const uint32_t kBenchIterations = 1000;
+
+static asic_shadow shadow;
+static asic_short_monitor monitor;
+
+typedef struct {
+  const char* name;
+  asicState (*run)(void);
+} bench_op;
+
+static asicState bench_adc_init(void) {
+  return asic_adc_init();
+}
+
+static asicState bench_pwm_init(void) {
+  return asic_pwm_init(true, 3, true, false, false);
+}
+
+static asicState bench_gpio_init(void) {
+  asic_gpio_init();
+  return kAsiceSuccess;
+}
+
+static asicState bench_pwm_duty_update(void) {
+  static uint16_t duty[ASIC_PWM_CHANNELS];
+  for (uint16_t channel = 0; channel < ASIC_PWM_CHANNELS; channel++) {
+    duty[channel]++;
+  }
+  return asic_pwm_set_frame(duty, NULL, 0xFFFF);
+}
+
+static asicState bench_adc_read(void) {
+  uint16_t reading;
+  if ((kAsiceSuccess != asic_adc_set_channel(kADCChannel_5V)) ||
+      (kAsiceSuccess != asic_adc_start_sample())) {
+    return kAsiceERR;
+  }
+  while (!asic_adc_ready()) {
+    /* Do nothing */
+  }
+  return asic_adc_get_value(&reading);
+}
+
+static asicState bench_load_sense_hold(void) {
+  return asic_adc_load_sense_hold();
+}
+
+static asicState bench_load_sense_map(void) {
+  static uint16_t map[ASIC_MAX_DEVICES * ASIC_LOAD_SENSE_CHANNELS];
+  return asic_adc_load_sense_map(0x01, 0xFFFF, map);
+}
+
+static asicState bench_short_response(void) {
+  asic_sim_inject_short(0, 0x0001);
+  return asic_short_monitor_poll(&monitor);
+}
+
+static const bench_op kBenchOps[] = {
+    {"adc_init", bench_adc_init},
+    {"pwm_init", bench_pwm_init},
+    {"gpio_init", bench_gpio_init},
+    {"pwm_duty_update", bench_pwm_duty_update},
+    {"adc_read", bench_adc_read},
+    {"load_sense_hold", bench_load_sense_hold},
+    {"short_response", bench_short_response},
+    {"load_sense_map", bench_load_sense_map},
+};
+
+static uint64_t now_ns(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return ((uint64_t)time.tv_sec * 1000000000u) + (uint64_t)time.tv_nsec;
+}
+
+/**
+ * @brief Bring up a chain of one asic with a warm register shadow
+ *
+ * @return asicState
+ */
+static asicState bench_setup(void) {
+  asic_spi_struct spi_struct = {.spi = &asic_sim_driver,
+                                .setCS = asic_sim_set_cs,
+                                .clearCS = asic_sim_clear_cs,
+                                .shadow = &shadow};
+  asic_sim_reset();
+  if ((kAsiceSuccess != asic_initSPI(&spi_struct, NULL)) ||
+      (kAsiceSuccess != asic_setAddress(0)) || (kAsiceSuccess != asic_adc_init()) ||
+      (kAsiceSuccess != asic_pwm_init(true, 3, true, false, false))) {
+    return kAsiceERR;
+  }
+  asic_gpio_init();
+  return asic_short_monitor_init(&monitor, 0x01, -1, true);
+}
+
+/**
+ * @brief Run one operation and print its cost
+ *
+ * @param op [in] Operation
+ * @return uint32_t Frames (reset and register) taken by one run, 0 on error
+ */
+static uint32_t bench_run(const bench_op* op) {
+  if (kAsiceSuccess != bench_setup()) {
+    return 0;
+  }
+
+  uint32_t frames = g_asic_sim.frames;
+  uint64_t bus_ns = g_asic_sim.elapsed_ns;
+  if (kAsiceSuccess != op->run()) {
+    return 0;
+  }
+  frames = g_asic_sim.frames - frames;
+  bus_ns = g_asic_sim.elapsed_ns - bus_ns;
+
+  uint64_t start = now_ns();
+  for (uint32_t i = 0; i < kBenchIterations; i++) {
+    op->run();
+  }
+  uint64_t wall_ns = (now_ns() - start) / kBenchIterations;
+
+  printf("%s,%u,%u,%llu,%llu\n", op->name, (unsigned)frames,
+         (unsigned)(frames * sizeof(uint32_t)), (unsigned long long)bus_ns,
+         (unsigned long long)wall_ns);
+  return frames;
+}
+
+int main(int argc, char** argv) {
+  static const size_t ops = sizeof(kBenchOps) / sizeof(kBenchOps[0]);
+  printf("operation,frames,bytes,bus_ns,wall_ns\n");
+  if (1 == argc) {
+    for (size_t i = 0; i < ops; i++) {
+      if (0 == bench_run(&kBenchOps[i])) {
+        return EXIT_FAILURE;
+      }
+    }
+    return EXIT_SUCCESS;
+  }
+
+  if (3 != argc) {
+    fprintf(stderr, "usage: %s [operation max_frames]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  for (size_t i = 0; i < ops; i++) {
+    if (0 != strcmp(argv[1], kBenchOps[i].name)) {
+      continue;
+    }
+
+    uint32_t budget = (uint32_t)strtoul(argv[2], NULL, 0);
+    uint32_t frames = bench_run(&kBenchOps[i]);
+    if ((0 == frames) || (frames > budget)) {
+      fprintf(stderr, "%s: %u frames, budget %u\n", argv[1], (unsigned)frames, (unsigned)budget);
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  fprintf(stderr, "unknown operation %s\n", argv[1]);
+  return EXIT_FAILURE;
+}
@@ -1,15 +1,141 @@
+#include <pthread.h>
+#include <sched.h>
 #include <setjmp.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <cmocka.h>
 
+#include "asic_adc.h"
+#include "asic_adc_stream.h"
+#include "asic_focus.h"
+#include "asic_link.h"
+#include "asic_pwm.h"
+#include "asic_pwm_stream.h"
+#include "asic_queue.h"
+#include "asic_short.h"
+#include "asic_sim.h"
 #include "asic_spi.h"
+#include "asic_stage.h"
 
 asic_spi_struct g_spi_struct = {0};
-ARM_DRIVER_SPI* g_spi = {0};
+ARM_DRIVER_SPI* g_spi = &asic_sim_driver;
 /* ---------------------------------- Mocks --------------------------------- */
 
+static asic_short_monitor monitor;
+static uint32_t short_reports;
+static uint32_t sync_edges;
+
+/* ADC sync toggle on GPIO 1, handed to the done hook to check it is ignored, SC detect on GPIO 2 */
+static void sim_gpio_edge(uint8_t address, uint8_t gpio) {
+  if (2 == gpio) {
+    asic_short_monitor_isr(&monitor);
+  } else {
+    sync_edges++;
+    asic_adc_done_isr(address);
+  }
+}
+
+static uint32_t sim_clock(void) {
+  return (uint32_t)g_asic_sim.elapsed_ns;
+}
+
+static void short_report(asic_short_monitor* reported) {
+  assert_ptr_equal(reported, &monitor);
+  short_reports++;
+}
+
+/* CRC error pin latched by an edge interrupt */
+static uint32_t crc_errors_seen;
+
+static bool sim_crc_error(void) {
+  bool error = (g_asic_sim.crc_errors != crc_errors_seen);
+  crc_errors_seen = g_asic_sim.crc_errors;
+  return error;
+}
+
+/* Queue stress test, every 8th command of a producer reads back its previous write */
+#define QUEUE_PRODUCERS 4
+#define QUEUE_COMMANDS 5000
+
+typedef struct {
+  uint8_t address;
+  uint32_t next; /* Next command expected back from the owner */
+  asic_request requests[QUEUE_COMMANDS];
+  uint16_t reads[QUEUE_COMMANDS];
+} queue_producer;
+
+static asic_queue queue;
+static asic_queue_slot queue_slots[64];
+static queue_producer producers[QUEUE_PRODUCERS];
+static atomic_uint producers_done;
+
+static bool queue_is_read(uint32_t command) {
+  return 7 == (command % 8);
+}
+
+static void queue_completed(asic_request* request) {
+  queue_producer* producer = request->context;
+  uint32_t command = (uint32_t)(request - producer->requests);
+  assert_int_equal(request->state, kAsicRequest_Done);
+  assert_int_equal(command, producer->next);
+  if (queue_is_read(command)) {
+    assert_int_equal(producer->reads[command], command);
+  }
+  producer->next++;
+}
+
+static void* queue_produce(void* argument) {
+  queue_producer* producer = argument;
+  for (uint32_t command = 0; command < QUEUE_COMMANDS; command++) {
+    asic_request* request = &producer->requests[command];
+    request->callback = queue_completed;
+    request->context = producer;
+    asicState state;
+    do {
+      state = queue_is_read(command)
+                  ? asic_queue_read(&queue, producer->address, REG_PWM0_DUTY,
+                                    &producer->reads[command], request)
+                  : asic_queue_write(&queue, producer->address, REG_PWM0_DUTY,
+                                     (uint16_t)(command + 1), request);
+      if (kAsiceSuccess != state) {
+        sched_yield();
+      }
+    } while (kAsiceSuccess != state);
+  }
+  atomic_fetch_add(&producers_done, 1);
+  return NULL;
+}
+
+/* Scheduler test, safety traffic raised part way through a housekeeping batch */
+#define SCHED_SLICE 4
+
+static asic_sched sched;
+static asic_queue_slot sched_slots[kAsicClass_Count * 16];
+static uint32_t sched_trigger;
+
+static void sched_frame_hook(uint32_t frame) {
+  (void)frame; /* Unused */
+  if (sched_trigger == g_asic_sim.register_frames) {
+    assert_int_equal(asic_sched_highz(&sched, 0x02), kAsiceSuccess);
+  }
+}
+
+static int setup(void** state) {
+  (void)state; /* Unused */
+
+  asic_spi_struct spi_struct = {.spi = &asic_sim_driver,
+                                .setCS = asic_sim_set_cs,
+                                .clearCS = asic_sim_clear_cs};
+  asic_sim_reset();
+  crc_errors_seen = 0;
+  if (kAsiceSuccess != asic_initSPI(&spi_struct, NULL)) {
+    return -1;
+  }
+  return (kAsiceSuccess == asic_setAddress(0)) ? 0 : -1;
+}
+
 /* ---------------------------------- Tests --------------------------------- */
 
 static void test_asic_spi_init(void** state) {
@@ -23,23 +149,1065 @@ static void test_asic_spi_init(void** state) {
   assert_int_equal(status, kAsiceERR);
 
   g_spi_struct.spi = g_spi;
+  g_spi_struct.setCS = asic_sim_set_cs;
+  g_spi_struct.clearCS = asic_sim_clear_cs;
   status = asic_initSPI(&g_spi_struct, NULL);
   assert_int_equal(status, kAsiceSuccess);
 }
 
 static void test_asic_spi_basic_write(void** state) {
   (void)state; /* Unused */
+
+  assert_int_equal(asic_setAddress(3), kAsiceSuccess);
+  assert_int_equal(asic_write(REG_PWM0_DUTY, 0x1234), kAsiceSuccess);
+  assert_int_equal(g_asic_sim.regs[3][REG_PWM0_DUTY], 0x1234);
+  assert_int_equal(g_asic_sim.regs[0][REG_PWM0_DUTY], 0);
+
+  /* Reset frame with CS high, then the register frame */
+  assert_int_equal(g_asic_sim.reset_frames, 1);
+  assert_int_equal(g_asic_sim.register_frames, 1);
+  assert_int_equal(g_asic_sim.protocol_errors, 0);
+  assert_false(asic_sim_log(1)->cs);
+  assert_true(asic_sim_log(0)->cs);
+  assert_int_equal(asic_sim_log(0)->frame, (3u << 26) | ((uint32_t)REG_PWM0_DUTY << 18) | 0x1234);
+  assert_false(g_asic_sim.cs);
 }
 
 static void test_asic_spi_basic_read(void** state) {
   (void)state; /* Unused */
+
+  g_asic_sim.regs[2][REG_GPIO_IN] = 0x000A;
+  assert_int_equal(asic_setAddress(2), kAsiceSuccess);
+
+  uint16_t data = 0;
+  assert_int_equal(asic_read(REG_GPIO_IN, &data), kAsiceSuccess);
+  assert_int_equal(data, 0x000A);
+  assert_int_equal(g_asic_sim.protocol_errors, 0);
+}
+
+static void test_asic_spi_read_burst(void** state) {
+  (void)state; /* Unused */
+
+  asicReg regs[40];
+  uint16_t data[40] = {0};
+  for (uint16_t i = 0; i < 40; i++) {
+    regs[i] = REG_PWM0_DUTY + (i % 32);
+    g_asic_sim.regs[4][REG_PWM0_DUTY + (i % 32)] = 0x100 + (i % 32);
+  }
+  assert_int_equal(asic_setAddress(4), kAsiceSuccess);
+  assert_int_equal(asic_read_burst(regs, 40, data), kAsiceSuccess);
+  for (uint16_t i = 0; i < 40; i++) {
+    assert_int_equal(data[i], 0x100 + (i % 32));
+  }
+  assert_int_equal(g_asic_sim.register_frames, 40);
+  assert_int_equal(g_asic_sim.protocol_errors, 0);
+}
+
+static void test_asic_spi_batch(void** state) {
+  (void)state; /* Unused */
+
+  uint32_t frames[4];
+  asic_batch batch;
+  assert_int_equal(asic_batch_begin(&batch, frames, 4), kAsiceSuccess);
+  for (uint16_t channel = 0; channel < 4; channel++) {
+    assert_int_equal(asic_batch_write(&batch, REG_PWM0_DUTY + (channel * 2), channel + 1),
+                     kAsiceSuccess);
+  }
+  assert_int_equal(asic_batch_submit(&batch), kAsiceSuccess);
+
+  for (uint16_t channel = 0; channel < 4; channel++) {
+    assert_int_equal(g_asic_sim.regs[0][REG_PWM0_DUTY + (channel * 2)], channel + 1);
+  }
+  assert_int_equal(g_asic_sim.reset_frames, 4);
+  assert_int_equal(g_asic_sim.register_frames, 4);
+  assert_int_equal(g_asic_sim.protocol_errors, 0);
+}
+
+static void test_asic_spi_pwm_sync(void** state) {
+  (void)state; /* Unused */
+
+  assert_int_equal(asic_pwm_set_config(true, false), kAsiceSuccess);
+  assert_int_equal(g_asic_sim.pwm_syncs[0], 1);
+  assert_int_equal(g_asic_sim.regs[0][REG_PWM_CONFIG] & ASIC_PWM_SYNC, 0);
+}
+
+static void test_asic_spi_adc_sample(void** state) {
+  (void)state; /* Unused */
+
+  g_asic_sim.adc_input[1][kADCChannel_5V] = 0x0321;
+  g_asic_sim.adc_conversion_frames = 20;
+  assert_int_equal(asic_setAddress(1), kAsiceSuccess);
+  assert_int_equal(asic_adc_set_channel(kADCChannel_5V), kAsiceSuccess);
+  assert_int_equal(asic_adc_start_sample(), kAsiceSuccess);
+  assert_false(asic_adc_ready());
+
+  uint32_t polls = 0;
+  while (!asic_adc_ready()) {
+    polls++;
+  }
+  assert_true(0 < polls);
+
+  uint16_t reading = 0;
+  assert_int_equal(asic_adc_get_value(&reading), kAsiceSuccess);
+  assert_int_equal(reading, 0x0321);
+}
+
+static void test_asic_spi_short_detect(void** state) {
+  (void)state; /* Unused */
+
+  asic_sim_inject_short(0, 0x0011);
+  uint16_t shorts = 0;
+  assert_int_equal(asic_pwm_short_circuit_get(&shorts), kAsiceSuccess);
+  assert_int_equal(shorts, 0x0011);
+
+  assert_int_equal(asic_pwm_short_circuit_clear(), kAsiceSuccess);
+  assert_int_equal(asic_pwm_short_circuit_get(&shorts), kAsiceSuccess);
+  assert_int_equal(shorts, 0);
+}
+
+static void test_asic_spi_adc_scan_irq(void** state) {
+  (void)state; /* Unused */
+
+  static const ADCChannels channels[] = {kADCChannel_hv, kADCChannel_1V8};
+  for (uint8_t address = 0; address < 2; address++) {
+    g_asic_sim.adc_input[address][kADCChannel_hv] = 0x100 + address;
+    g_asic_sim.adc_input[address][kADCChannel_1V8] = 0x200 + address;
+  }
+  /* Bus time only passes while frames are sent, so convert immediately */
+  g_asic_sim.adc_conversion_frames = 1;
+  g_asic_sim.adc_complete = asic_adc_done_isr;
+  assert_int_equal(asic_broadcast_begin(0x03), kAsiceSuccess);
+  assert_int_equal(asic_adc_done_irq_enable(1), kAsiceSuccess);
+  assert_int_equal(asic_broadcast_end(), kAsiceSuccess);
+
+  uint16_t results[4] = {0};
+  uint32_t frames = g_asic_sim.register_frames;
+  assert_int_equal(asic_adc_scan(channels, 2, 0x03, results), kAsiceSuccess);
+  assert_int_equal(results[0], 0x100);
+  assert_int_equal(results[1], 0x101);
+  assert_int_equal(results[2], 0x200);
+  assert_int_equal(results[3], 0x201);
+
+  /* ADC_STATE read (no shadow) and start, then read value and restart per asic, no polls */
+  assert_int_equal(g_asic_sim.register_frames - frames, 2 + 2 + 4 + 2);
+  asic_adc_done_irq_disable();
+}
+
+static void test_asic_spi_adc_sync_edges(void** state) {
+  (void)state; /* Unused */
+
+  g_asic_sim.gpio_edge = sim_gpio_edge;
+  sync_edges = 0;
+  assert_int_equal(asic_broadcast_begin(0x03), kAsiceSuccess);
+  assert_int_equal(asic_adc_done_irq_enable(1), kAsiceSuccess);
+  assert_int_equal(asic_broadcast_end(), kAsiceSuccess);
+
+  /* The routed pin toggles on every sync, and none of those edges marks a conversion done */
+  assert_int_equal(asic_setAddress(1), kAsiceSuccess);
+  assert_int_equal(asic_adc_sync(), kAsiceSuccess);
+  assert_int_equal(sync_edges, 1);
+  assert_int_equal(asic_adc_load_sense_hold(), kAsiceSuccess);
+  assert_true(1 < sync_edges);
+  assert_int_equal(sync_edges, g_asic_sim.adc_syncs[1]);
+  assert_false(asic_adc_ready());
+  asic_adc_done_irq_disable();
+}
+
+static void test_asic_spi_adc_done_fallback(void** state) {
+  (void)state; /* Unused */
+
+  g_asic_sim.adc_input[1][kADCChannel_5V] = 0x0321;
+  g_asic_sim.adc_conversion_frames = 20;
+  assert_int_equal(asic_setAddress(1), kAsiceSuccess);
+  assert_int_equal(asic_adc_done_irq_enable(1), kAsiceSuccess);
+
+  /* Nothing started yet, so a completion is ignored */
+  asic_adc_done_isr(1);
+  assert_false(asic_adc_ready());
+
+  /* No completion is ever signalled, the ready loop still ends on a bus poll */
+  assert_int_equal(asic_adc_set_channel(kADCChannel_5V), kAsiceSuccess);
+  assert_int_equal(asic_adc_start_sample(), kAsiceSuccess);
+  uint32_t frames = g_asic_sim.register_frames;
+  uint32_t polls = 0;
+  while (!asic_adc_ready()) {
+    polls++;
+  }
+  assert_true(64 < polls);
+  assert_true(g_asic_sim.register_frames - frames < polls);
+
+  uint16_t reading = 0;
+  assert_int_equal(asic_adc_get_value(&reading), kAsiceSuccess);
+  assert_int_equal(reading, 0x0321);
+  asic_adc_done_irq_disable();
+}
+
+static void test_asic_spi_link_training(void** state) {
+  (void)state; /* Unused */
+
+  static const asic_link_config config = {.min_speed = 10000000,
+                                          .max_speed = 30000000,
+                                          .step = 2000000,
+                                          .margin = 10,
+                                          .address_mask = 0x03,
+                                          .test_reg = REG_PWM0_DELAY,
+                                          .crc_gpio = 0,
+                                          .crc_error = sim_crc_error};
+  asic_link link;
+  g_asic_sim.max_bus_speed = 22000000;
+  g_asic_sim.regs[1][REG_PWM0_DELAY] = 0x0042;
+  g_asic_sim.regs[1][REG_GPIO_OE] = 0x0004;
+  assert_int_equal(asic_link_train(&link, &config), kAsiceSuccess);
+  assert_int_equal(g_asic_sim.regs[0][REG_GPIO_OE], 0x0001);
+  assert_int_equal(g_asic_sim.regs[1][REG_GPIO_OE], 0x0005);
+  assert_int_equal(link.fastest, 22000000);
+  assert_int_equal(g_asic_sim.bus_speed, 19800000);
+  assert_int_equal(g_asic_sim.regs[1][REG_PWM0_DELAY], 0x0042);
+
+  /* Link degrades at runtime */
+  g_asic_sim.max_bus_speed = 18000000;
+  assert_int_equal(asic_write(REG_PWM0_DUTY, 0), kAsiceSuccess);
+  assert_int_equal(asic_link_check(&link), kAsiceSuccess);
+  assert_int_equal(g_asic_sim.bus_speed, 17800000);
+  assert_int_equal(link.step_downs, 1);
+  assert_int_equal(asic_write(REG_PWM0_DUTY, 0), kAsiceSuccess);
+  assert_int_equal(asic_link_check(&link), kAsiceSuccess);
+  assert_int_equal(link.step_downs, 1);
+
+  /* Nothing reliable */
+  g_asic_sim.max_bus_speed = 1000000;
+  assert_int_equal(asic_link_train(&link, &config), kAsiceERR);
+  assert_int_equal(g_asic_sim.bus_speed, 10000000);
+}
+
+static void test_asic_spi_retransmit(void** state) {
+  (void)state; /* Unused */
+
+  uint32_t frames[4];
+  asic_batch batch;
+  asic_retry_stats retry;
+  assert_int_equal(asic_set_retransmit(sim_crc_error, 2), kAsiceSuccess);
+
+  /* Clean link, only the pin is checked */
+  assert_int_equal(asic_batch_begin(&batch, frames, 4), kAsiceSuccess);
+  for (uint16_t channel = 0; channel < 4; channel++) {
+    assert_int_equal(asic_batch_write(&batch, REG_PWM0_DUTY + (channel * 2), 0x10), kAsiceSuccess);
+  }
+  assert_int_equal(asic_batch_submit(&batch), kAsiceSuccess);
+  assert_int_equal(g_asic_sim.register_frames, 4);
+
+  /* Two corrupted writes, read back once and only those two resent */
+  g_asic_sim.corrupt = 0x5;
+  for (uint16_t channel = 0; channel < 4; channel++) {
+    assert_int_equal(asic_batch_write(&batch, REG_PWM0_DUTY + (channel * 2), 0x20 + channel),
+                     kAsiceSuccess);
+  }
+  assert_int_equal(asic_batch_submit(&batch), kAsiceSuccess);
+  for (uint16_t channel = 0; channel < 4; channel++) {
+    assert_int_equal(g_asic_sim.regs[0][REG_PWM0_DUTY + (channel * 2)], 0x20 + channel);
+  }
+  assert_int_equal(g_asic_sim.register_frames, 4 + 4 + 4 + 2 + 2);
+  asic_retry_snapshot(&retry);
+  assert_int_equal(retry.checks, 2);
+  assert_int_equal(retry.crc_errors, 1);
+  assert_int_equal(retry.retransmits, 2);
+  assert_int_equal(retry.failures, 0);
+
+  /* Write that never lands */
+  g_asic_sim.corrupt = 0xFFFFFFFF;
+  assert_int_equal(asic_write(REG_PWM0_DELAY, 0x0100), kAsiceERR);
+  g_asic_sim.corrupt = 0;
+  asic_retry_snapshot(&retry);
+  assert_int_equal(retry.retransmits, 2 + 2);
+  assert_int_equal(retry.failures, 1);
+
+  /* No pin, every write is read back */
+  assert_int_equal(asic_set_retransmit(NULL, 1), kAsiceSuccess);
+  g_asic_sim.corrupt = 0x1;
+  assert_int_equal(asic_write(REG_PWM0_DELAY, 0x0100), kAsiceSuccess);
+  assert_int_equal(g_asic_sim.regs[0][REG_PWM0_DELAY], 0x0100);
+  asic_retry_snapshot(&retry);
+  assert_int_equal(retry.retransmits, 2 + 2 + 1);
+  assert_int_equal(asic_set_retransmit(NULL, 0), kAsiceSuccess);
+}
+
+static void test_asic_spi_short_monitor(void** state) {
+  (void)state; /* Unused */
+
+  g_asic_sim.regs[0][REG_PWM_OE] = 0xFFFF;
+  g_asic_sim.regs[2][REG_PWM_OE] = 0xFFFF;
+  g_asic_sim.regs[2][REG_PWM_CONFIG] = 0x0003;
+  g_asic_sim.regs[0][REG_GPIO_OE] = 0x0001;
+  g_asic_sim.regs[2][REG_GPIO_OE] = 0x0008;
+  g_asic_sim.regs[2][REG_GPIO_OUTSEL] = 0x0001;
+  g_asic_sim.gpio_edge = sim_gpio_edge;
+  short_reports = 0;
+  assert_int_equal(asic_short_monitor_init(&monitor, 0x05, 2, true), kAsiceSuccess);
+
+  /* Each asic keeps its own setup of the other GPIOs */
+  assert_int_equal(g_asic_sim.regs[0][REG_GPIO_OE], 0x0005);
+  assert_int_equal(g_asic_sim.regs[2][REG_GPIO_OE], 0x000C);
+  assert_int_equal(g_asic_sim.regs[0][REG_GPIO_OUTSEL], 0x0200);
+  assert_int_equal(g_asic_sim.regs[2][REG_GPIO_OUTSEL], 0x0201);
+  monitor.callback = short_report;
+  monitor.timestamp = sim_clock;
+
+  /* No trigger, no bus traffic */
+  uint32_t frames = g_asic_sim.register_frames;
+  assert_int_equal(asic_short_monitor_service(&monitor), kAsiceSuccess);
+  assert_int_equal(g_asic_sim.register_frames, frames);
+
+  /* Read both asics in one transfer, then high-Z, sync and clear the shorted one */
+  asic_sim_inject_short(2, 0x0300);
+  assert_true(monitor.triggered);
+  assert_int_equal(asic_short_monitor_service(&monitor), kAsiceSuccess);
+  assert_int_equal(g_asic_sim.register_frames - frames, 2 + 3);
+  assert_int_equal(short_reports, 1);
+  assert_int_equal(monitor.shorted, 0x04);
+  assert_int_equal(monitor.shorts[2], 0x0300);
+  assert_int_equal(monitor.shorts[0], 0);
+  assert_int_equal(g_asic_sim.regs[2][REG_PWM_OE], 0x0000);
+  assert_int_equal(g_asic_sim.regs[2][REG_PWM_CONFIG], 0x0003);
+  assert_int_equal(g_asic_sim.pwm_syncs[2], 1);
+  assert_int_equal(g_asic_sim.regs[2][REG_SHORT_DETECT], 0);
+  assert_int_equal(g_asic_sim.regs[0][REG_PWM_OE], 0xFFFF);
+  assert_true(0 < monitor.latency);
+  assert_int_equal(monitor.latency, monitor.latency_max);
+
+  /* Cleared flags raise the pin again on the next short */
+  asic_sim_inject_short(2, 0x0001);
+  assert_true(monitor.triggered);
+  assert_int_equal(asic_short_monitor_poll(&monitor), kAsiceSuccess);
+  assert_int_equal(asic_short_monitor_poll(&monitor), kAsiceSuccess);
+  assert_int_equal(short_reports, 2);
+  assert_int_equal(monitor.events, 2);
+  g_asic_sim.gpio_edge = NULL;
+}
+
+static void test_asic_spi_queue_stress(void** state) {
+  (void)state; /* Unused */
+
+  pthread_t threads[QUEUE_PRODUCERS];
+  assert_int_equal(asic_queue_init(&queue, queue_slots, 64), kAsiceSuccess);
+  atomic_store(&producers_done, 0);
+  for (uint8_t i = 0; i < QUEUE_PRODUCERS; i++) {
+    producers[i].address = i;
+    producers[i].next = 0;
+    assert_int_equal(pthread_create(&threads[i], NULL, queue_produce, &producers[i]), 0);
+  }
+
+  /* This thread owns the bus */
+  while (QUEUE_PRODUCERS != atomic_load(&producers_done)) {
+    assert_int_equal(asic_queue_service(&queue), kAsiceSuccess);
+  }
+  for (uint8_t i = 0; i < QUEUE_PRODUCERS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  assert_int_equal(asic_queue_service(&queue), kAsiceSuccess);
+
+  for (uint8_t i = 0; i < QUEUE_PRODUCERS; i++) {
+    assert_int_equal(producers[i].next, QUEUE_COMMANDS);
+    assert_int_equal(g_asic_sim.regs[i][REG_PWM0_DUTY], QUEUE_COMMANDS - 1);
+  }
+  assert_int_equal(queue.commands, QUEUE_PRODUCERS * QUEUE_COMMANDS);
+  assert_int_equal(g_asic_sim.register_frames, QUEUE_PRODUCERS * QUEUE_COMMANDS);
+  assert_int_equal(g_asic_sim.protocol_errors, 0);
+}
+
+static void test_asic_spi_sched_preempt(void** state) {
+  (void)state; /* Unused */
+
+  uint32_t frames[40];
+  for (uint16_t i = 0; i < 40; i++) {
+    frames[i] = asic_frame_encode(0, REG_PWM0_DELAY + (i % 32), false, i);
+  }
+  g_asic_sim.regs[1][REG_PWM_OE] = 0xFFFF;
+  g_asic_sim.regs[1][REG_PWM_CONFIG] = 0x0003;
+  assert_int_equal(asic_sched_init(&sched, sched_slots, 16, SCHED_SLICE, 0x03), kAsiceSuccess);
+  asic_sched_set_clock(&sched, sim_clock);
+
+  asic_request bulk = {0};
+  asic_request control = {0};
+  assert_int_equal(asic_sched_submit(&sched, kAsicClass_Housekeeping, frames, 40, &bulk),
+                   kAsiceSuccess);
+  assert_int_equal(asic_sched_write(&sched, kAsicClass_Control, 0, REG_PWM0_DUTY, 0x55, &control),
+                   kAsiceSuccess);
+
+  /* Control first, then the short raised during the 10th frame overtakes the bulk batch */
+  uint32_t start = g_asic_sim.register_frames;
+  sched_trigger = start + 10;
+  g_asic_sim.frame_hook = sched_frame_hook;
+  assert_int_equal(asic_sched_service(&sched), kAsiceSuccess);
+  g_asic_sim.frame_hook = NULL;
+  assert_true(asic_request_done(&control));
+  assert_true(asic_request_done(&bulk));
+  assert_int_equal(g_asic_sim.register_frames - start, 1 + 40 + 2);
+
+  uint32_t highz = asic_frame_encode(1, REG_PWM_OE, false, 0);
+  uint32_t position = 0;
+  for (uint32_t age = 2 * (1 + 40 + 2); 0 < age; age--) {
+    const asic_sim_log_entry* entry = asic_sim_log(age - 1);
+    if (!entry->cs) {
+      continue;
+    }
+    position++;
+    if (1 == position) {
+      assert_int_equal(entry->frame, asic_frame_encode(0, REG_PWM0_DUTY, false, 0x55));
+    }
+    if (highz == entry->frame) {
+      break;
+    }
+  }
+  assert_in_range(position, 11, 10 + SCHED_SLICE + 1);
+  assert_int_equal(g_asic_sim.regs[1][REG_PWM_OE], 0);
+  assert_int_equal(g_asic_sim.regs[1][REG_PWM_CONFIG], 0x0003);
+  assert_int_equal(g_asic_sim.pwm_syncs[1], 1);
+
+  /* Waited for at most one slice (reset and register frame each) */
+  const asic_sched_class* safety = &sched.classes[kAsicClass_Safety];
+  assert_true(safety->latency_max <= (uint32_t)(SCHED_SLICE * 2 * 1934));
+  assert_int_equal(sched.classes[kAsicClass_Housekeeping].preemptions, 1);
+}
+
+/* Buffer position and bus order of each PWM sync */
+static const uint32_t* sync_tx[ASIC_MAX_DEVICES];
+static uint32_t sync_frame[ASIC_MAX_DEVICES];
+static uint32_t syncs_seen;
+
+static void sync_frame_hook(uint32_t frame) {
+  if ((REG_PWM_CONFIG == ((frame >> 18) & 0xFF)) && (0 != (frame & ASIC_PWM_SYNC)) &&
+      (syncs_seen < ASIC_MAX_DEVICES)) {
+    sync_tx[syncs_seen] = g_asic_sim.last_tx;
+    sync_frame[syncs_seen++] = g_asic_sim.register_frames;
+  }
+}
+
+static void test_asic_spi_stage_commit(void** state) {
+  (void)state; /* Unused */
+
+  static asic_shadow shadow;
+  static asic_stage stage;
+  asic_spi_struct spi_struct = {.spi = &asic_sim_driver,
+                                .setCS = asic_sim_set_cs,
+                                .clearCS = asic_sim_clear_cs,
+                                .shadow = &shadow};
+  assert_int_equal(asic_initSPI(&spi_struct, NULL), kAsiceSuccess);
+  assert_int_equal(asic_stage_init(&stage), kAsiceSuccess);
+
+  /* Nothing known yet, every staged value is sent, then one sync per asic */
+  uint32_t saved;
+  uint32_t frames = g_asic_sim.register_frames;
+  for (uint32_t address = 0; address < 2; address++) {
+    asic_stage_write(&stage, address, REG_PWM_CONFIG, 0x0003);
+    for (uint16_t channel = 0; channel < 16; channel++) {
+      asic_stage_write(&stage, address, REG_PWM0_DUTY + (channel * 2), 0x100 + channel);
+      asic_stage_write(&stage, address, REG_PWM0_DELAY + (channel * 2), 0x200 + channel);
+    }
+  }
+  assert_int_equal(g_asic_sim.register_frames, frames);
+  syncs_seen = 0;
+  g_asic_sim.frame_hook = sync_frame_hook;
+  assert_int_equal(asic_stage_commit(&stage, &saved), kAsiceSuccess);
+  g_asic_sim.frame_hook = NULL;
+  assert_int_equal(g_asic_sim.register_frames - frames, 64 + 2);
+  assert_int_equal(saved, 2);
+
+  /* More than one transfer, both syncs come last and together */
+  assert_int_equal(syncs_seen, 2);
+  assert_int_equal(sync_frame[0] - frames, 64 + 1);
+  assert_int_equal(sync_frame[1] - frames, 64 + 2);
+  assert_ptr_equal(sync_tx[1], sync_tx[0] + 1);
+  assert_int_equal(g_asic_sim.pwm_syncs[0], 1);
+  assert_int_equal(g_asic_sim.pwm_syncs[1], 1);
+  assert_int_equal(g_asic_sim.regs[1][REG_PWM0_DELAY + 30], 0x20F);
+
+  /* Same frame again with three changes on asic 0, only those and its sync are sent */
+  frames = g_asic_sim.register_frames;
+  for (uint32_t address = 0; address < 2; address++) {
+    asic_stage_write(&stage, address, REG_PWM_CONFIG, 0x0003);
+    for (uint16_t channel = 0; channel < 16; channel++) {
+      uint16_t duty = ((0 == address) && (channel < 3)) ? 0x300 : 0x100 + channel;
+      asic_stage_write(&stage, address, REG_PWM0_DUTY + (channel * 2), duty);
+      asic_stage_write(&stage, address, REG_PWM0_DELAY + (channel * 2), 0x200 + channel);
+    }
+  }
+  assert_int_equal(asic_stage_commit(&stage, &saved), kAsiceSuccess);
+  assert_int_equal(g_asic_sim.register_frames - frames, 3 + 1);
+  assert_int_equal(saved, 68 - 4);
+  assert_int_equal(g_asic_sim.regs[0][REG_PWM0_DUTY + 4], 0x300);
+  assert_int_equal(g_asic_sim.regs[0][REG_PWM_CONFIG], 0x0003);
+  assert_int_equal(g_asic_sim.pwm_syncs[0], 2);
+  assert_int_equal(g_asic_sim.pwm_syncs[1], 1);
+
+  /* Change staged and staged back, or discarded, costs nothing */
+  frames = g_asic_sim.register_frames;
+  asic_stage_write(&stage, 1, REG_PWM0_DUTY, 0x0000);
+  asic_stage_write(&stage, 1, REG_PWM0_DUTY, 0x0100);
+  assert_int_equal(asic_stage_commit(&stage, &saved), kAsiceSuccess);
+  asic_stage_write(&stage, 1, REG_PWM0_DUTY, 0x0000);
+  asic_stage_discard(&stage);
+  assert_int_equal(asic_stage_commit(&stage, NULL), kAsiceSuccess);
+  assert_int_equal(g_asic_sim.register_frames, frames);
+  assert_int_equal(saved, 2 + 1);
+  assert_int_equal(stage.frames, 66 + 4);
+  assert_int_equal(stage.saved, 2 + 64 + 3);
+}
+
+/* Frames submitted again from the completion of the previous submit */
+static uint32_t resubmit_frame;
+static asic_request resubmit_request;
+
+static void resubmit_done(asic_request* request) {
+  (void)request; /* Unused */
+  resubmit_request.callback = NULL;
+  assert_int_equal(asic_submit_frames(&resubmit_frame, 1, &resubmit_request), kAsiceSuccess);
+}
+
+/* Write issued from the completion of an earlier asynchronous write */
+static asic_request chained_request;
+
+static void chained_write_done(asic_request* request) {
+  (void)request; /* Unused */
+  assert_int_equal(asic_write_async(REG_PWM0_DUTY, 2, &chained_request), kAsiceSuccess);
+}
+
+static asic_batch chained_batch;
+static uint32_t chained_frames[2];
+
+static void chained_batch_done(asic_request* request) {
+  (void)request; /* Unused */
+  assert_int_equal(asic_batch_write(&chained_batch, REG_PWM0_DELAY, 4), kAsiceSuccess);
+  assert_int_equal(asic_batch_submit_async(&chained_batch, &chained_request), kAsiceSuccess);
+}
+
+static void test_asic_spi_async_shadow(void** state) {
+  (void)state; /* Unused */
+
+  static asic_shadow shadow;
+  asic_spi_struct spi_struct = {.spi = &asic_sim_driver,
+                                .setCS = asic_sim_set_cs,
+                                .clearCS = asic_sim_clear_cs,
+                                .shadow = &shadow};
+  assert_int_equal(asic_initSPI(&spi_struct, NULL), kAsiceSuccess);
+
+  /* The chained write lands last on the chip and in the shadow */
+  uint16_t duty;
+  asic_request request = {.callback = chained_write_done};
+  assert_int_equal(asic_write_async(REG_PWM0_DUTY, 1, &request), kAsiceSuccess);
+  assert_true(asic_request_done(&chained_request));
+  assert_int_equal(g_asic_sim.regs[0][REG_PWM0_DUTY], 2);
+  assert_int_equal(asic_read_cached(REG_PWM0_DUTY, &duty), kAsiceSuccess);
+  assert_int_equal(duty, 2);
+
+  /* Same for a batch submitted from the completion of an earlier batch */
+  uint32_t frames[2];
+  asic_batch batch;
+  uint16_t delay;
+  chained_request.state = kAsicRequest_Pending;
+  request.callback = chained_batch_done;
+  assert_int_equal(asic_batch_begin(&chained_batch, chained_frames, 2), kAsiceSuccess);
+  assert_int_equal(asic_batch_begin(&batch, frames, 2), kAsiceSuccess);
+  assert_int_equal(asic_batch_write(&batch, REG_PWM0_DELAY, 3), kAsiceSuccess);
+  assert_int_equal(asic_batch_submit_async(&batch, &request), kAsiceSuccess);
+  assert_true(asic_request_done(&chained_request));
+  assert_int_equal(g_asic_sim.regs[0][REG_PWM0_DELAY], 4);
+  assert_int_equal(asic_read_cached(REG_PWM0_DELAY, &delay), kAsiceSuccess);
+  assert_int_equal(delay, 4);
+}
+
+static void test_asic_spi_frame_submit(void** state) {
+  (void)state; /* Unused */
+
+  /* Headers built at compile time, only the data is patched per update */
+  static const uint32_t headers[4] = {ASIC_FRAME_HEADER(1, REG_PWM0_DUTY, false),
+                                      ASIC_FRAME_HEADER(1, REG_PWM0_DELAY, false),
+                                      ASIC_FRAME_HEADER(2, REG_PWM0_DUTY, false),
+                                      ASIC_FRAME_HEADER(2, REG_PWM0_DELAY, false)};
+  static const uint16_t data[4] = {0x0123, 0x0456, 0x0789, 0x0ABC};
+  uint32_t frames[4];
+  for (uint16_t i = 0; i < 4; i++) {
+    frames[i] = ASIC_FRAME_PATCH(headers[i], 0xFFFF);
+    assert_int_equal(headers[i], asic_frame_encode(1 + (i / 2), REG_PWM0_DUTY + (i % 2), false, 0));
+  }
+  asic_frames_patch(frames, data, 4);
+  assert_int_equal(frames[3], asic_frame_encode(2, REG_PWM0_DELAY, false, 0x0ABC));
+  assert_int_equal(ASIC_FRAME_HEADER(3, REG_ADC_VAL, true),
+                   asic_frame_encode(3, REG_ADC_VAL, true, 0x1234));
+
+  /* The driver is handed the caller's buffer */
+  asic_request request = {0};
+  assert_int_equal(asic_submit_frames(frames, 4, &request), kAsiceSuccess);
+  assert_true(asic_request_done(&request));
+  assert_int_equal(request.state, kAsicRequest_Done);
+  assert_ptr_equal(g_asic_sim.last_tx, &frames[3]);
+  assert_int_equal(g_asic_sim.register_frames, 4);
+  assert_int_equal(g_asic_sim.regs[1][REG_PWM0_DELAY], 0x0456);
+  assert_int_equal(g_asic_sim.regs[2][REG_PWM0_DUTY], 0x0789);
+  assert_int_equal(asic_submit_frames(frames, 0, &request), kAsiceERR);
+
+  /* A submit from the completion callback leaves the newer value in the shadow */
+  static asic_shadow shadow;
+  asic_spi_struct spi_struct = {.spi = &asic_sim_driver,
+                                .setCS = asic_sim_set_cs,
+                                .clearCS = asic_sim_clear_cs,
+                                .shadow = &shadow};
+  assert_int_equal(asic_initSPI(&spi_struct, NULL), kAsiceSuccess);
+  uint16_t duty;
+  frames[0] = asic_frame_encode(0, REG_PWM0_DUTY, false, 1);
+  resubmit_frame = asic_frame_encode(0, REG_PWM0_DUTY, false, 2);
+  request.callback = resubmit_done;
+  assert_int_equal(asic_submit_frames(frames, 1, &request), kAsiceSuccess);
+  request.callback = NULL;
+  assert_true(asic_request_done(&resubmit_request));
+  assert_int_equal(g_asic_sim.regs[0][REG_PWM0_DUTY], 2);
+  assert_true(asic_chain_shadow_get(asic_default_chain(), 0, REG_PWM0_DUTY, &duty));
+  assert_int_equal(duty, 2);
+
+  /* Read frames are not taken as register values */
+  frames[0] = asic_frame_encode(0, REG_PWM0_DELAY, true, 0);
+  assert_int_equal(asic_submit_frames(frames, 1, &request), kAsiceSuccess);
+  assert_false(asic_chain_shadow_get(asic_default_chain(), 0, REG_PWM0_DELAY, &duty));
+
+  /* Stream buffers are encoded once and patched in place */
+  static asic_pwm_stream stream;
+  static asic_pwm_frame ring[2];
+  g_asic_sim.regs[1][REG_PWM_CONFIG] = 0x0003;
+  assert_int_equal(asic_pwm_stream_init(&stream, ring, 2, 0x02, 1), kAsiceSuccess);
+  assert_int_equal(stream.count, (2 * ASIC_PWM_CHANNELS) + 1);
+  asic_pwm_frame* frame = asic_pwm_stream_next(&stream);
+  for (uint16_t channel = 0; channel < ASIC_PWM_CHANNELS; channel++) {
+    frame->duty[1][channel] = 0x100 + channel;
+    frame->delay[1][channel] = 0x200 + channel;
+  }
+  assert_int_equal(asic_pwm_stream_push(&stream), kAsiceSuccess);
+  assert_int_equal(asic_pwm_stream_start(&stream), kAsiceSuccess);
+  uint32_t sent = g_asic_sim.register_frames;
+  asic_pwm_stream_tick(&stream);
+  assert_int_equal(g_asic_sim.register_frames - sent, stream.count);
+  assert_int_equal(stream.sent, 1);
+  assert_int_equal(g_asic_sim.regs[1][REG_PWM0_DUTY + 2], 0x101);
+  assert_int_equal(g_asic_sim.regs[1][REG_PWM0_DELAY + 2], 0x201);
+  assert_int_equal(g_asic_sim.regs[1][REG_PWM_CONFIG], 0x0003);
+  assert_int_equal(g_asic_sim.pwm_syncs[1], 1);
+  asic_pwm_stream_stop(&stream);
+}
+
+/* Semaphore held by the test, the stream may only try to take it */
+static bool sem_taken;
+static uint32_t sem_blocking_takes;
+
+static void sem_lock(void) {
+  sem_blocking_takes++;
+  sem_taken = true;
+}
+
+static void sem_unlock(void) {
+  sem_taken = false;
+}
+
+static bool sem_try_lock(void) {
+  if (sem_taken) {
+    return false;
+  }
+  sem_taken = true;
+  return true;
+}
+
+static void sem_callback(uint32_t event) {
+  asic_sim_clear_cs();
+  if (ARM_SPI_EVENT_TRANSFER_COMPLETE == event) {
+    sem_taken = false;
+  }
+}
+
+/* Timer tick landing while a stream frame is on the bus */
+static asic_pwm_stream* tick_stream;
+static uint32_t tick_pending;
+
+static void stream_tick_hook(uint32_t frame) {
+  (void)frame; /* Unused */
+  if (0 < tick_pending) {
+    tick_pending--;
+    asic_pwm_stream_tick(tick_stream);
+  }
+}
+
+static void test_asic_spi_stream_try_lock(void** state) {
+  (void)state; /* Unused */
+
+  static asic_pwm_stream stream;
+  static asic_pwm_frame ring[3];
+  asic_spi_struct spi_struct = {.spi = &asic_sim_driver,
+                                .lockSem = sem_lock,
+                                .unlockSem = sem_unlock,
+                                .setCS = asic_sim_set_cs,
+                                .clearCS = asic_sim_clear_cs};
+  sem_taken = false;
+  assert_int_equal(asic_initSPI(&spi_struct, sem_callback), kAsiceSuccess);
+  assert_int_equal(asic_pwm_stream_init(&stream, ring, 3, 0x02, 1), kAsiceERR);
+
+  spi_struct.tryLockSem = sem_try_lock;
+  assert_int_equal(asic_initSPI(&spi_struct, sem_callback), kAsiceSuccess);
+  assert_int_equal(asic_pwm_stream_init(&stream, ring, 3, 0x02, 1), kAsiceSuccess);
+  for (uint16_t i = 0; i < 2; i++) {
+    asic_pwm_frame* frame = asic_pwm_stream_next(&stream);
+    frame->duty[1][0] = 0x100 + i;
+    assert_int_equal(asic_pwm_stream_push(&stream), kAsiceSuccess);
+  }
+  assert_int_equal(asic_pwm_stream_start(&stream), kAsiceSuccess);
+  uint32_t takes = sem_blocking_takes;
+  asic_pwm_stream_tick(&stream);
+  assert_int_equal(stream.sent, 1);
+  assert_int_equal(g_asic_sim.regs[1][REG_PWM0_DUTY], 0x100);
+
+  /* Bus held elsewhere, the frame waits for the next tick instead of blocking */
+  sem_taken = true;
+  asic_pwm_stream_tick(&stream);
+  assert_int_equal(stream.sent, 1);
+  assert_int_equal(stream.late, 1);
+  assert_int_equal(stream.errors, 0);
+  sem_taken = false;
+  asic_pwm_stream_tick(&stream);
+  assert_int_equal(stream.sent, 2);
+  assert_int_equal(g_asic_sim.regs[1][REG_PWM0_DUTY], 0x101);
+  assert_int_equal(sem_blocking_takes, takes);
+
+  /* The frame due mid transfer goes out once, right after the completion */
+  for (uint16_t i = 0; i < 2; i++) {
+    asic_pwm_stream_next(&stream)->duty[1][0] = 0x200 + i;
+    assert_int_equal(asic_pwm_stream_push(&stream), kAsiceSuccess);
+  }
+  uint32_t sent = g_asic_sim.register_frames;
+  tick_stream = &stream;
+  tick_pending = 1;
+  g_asic_sim.frame_hook = stream_tick_hook;
+  asic_pwm_stream_tick(&stream);
+  g_asic_sim.frame_hook = NULL;
+  assert_int_equal(stream.sent, 4);
+  assert_int_equal(stream.late, 2);
+  assert_int_equal(g_asic_sim.register_frames - sent, 2 * stream.count);
+  assert_int_equal(g_asic_sim.regs[1][REG_PWM0_DUTY], 0x201);
+  assert_false(atomic_load(&stream.overdue));
+  asic_pwm_stream_stop(&stream);
+}
+
+static void test_asic_spi_focus(void** state) {
+  (void)state; /* Unused */
+
+  /* Transducers along x on asic 1, 40 mm below the focus, distances of 40, 41, 50 and 58 mm */
+  static asic_focus_geometry geometry;
+  static const int32_t x[4] = {0, 9000, 30000, 42000};
+  static const uint16_t delays[4] = {0, 896, 768, 768};
+  for (uint16_t channel = 0; channel < ASIC_PWM_CHANNELS; channel++) {
+    geometry.x[ASIC_PWM_CHANNELS + channel] = x[channel % 4];
+  }
+
+  /* 8 mm wavelength and 1024 PWM clocks per cycle */
+  asic_focus focus;
+  asic_pwm_frame frame = {0};
+  assert_int_equal(asic_focus_init(&focus, &geometry, 0x02, 40960000, 40000, 320000),
+                   kAsiceSuccess);
+  assert_int_equal(focus.period, 1024);
+  assert_int_equal(focus.wavelength, 8000);
+
+  asic_focus_point point = {.x = 0, .y = 0, .z = 40000, .amplitude = ASIC_FOCUS_AMPLITUDE_MAX};
+  assert_int_equal(asic_focus_compute(&focus, &point, 1, &frame), kAsiceSuccess);
+  for (uint16_t channel = 0; channel < ASIC_PWM_CHANNELS; channel++) {
+    assert_int_equal(frame.delay[1][channel], delays[channel % 4]);
+    assert_int_equal(frame.duty[1][channel], 512);
+  }
+  assert_int_equal(frame.duty[0][0], 0);
+
+  /* Two halves of the same point sum to the single point, at its absolute amplitude */
+  point.amplitude = ASIC_FOCUS_AMPLITUDE_MAX / 2;
+  assert_int_equal(asic_focus_compute(&focus, &point, 1, &frame), kAsiceSuccess);
+  assert_int_equal(frame.duty[1][0], 256);
+  asic_focus_point points[2] = {point, point};
+  points[0].amplitude = ASIC_FOCUS_AMPLITUDE_MAX / 4;
+  points[1].amplitude = ASIC_FOCUS_AMPLITUDE_MAX / 4;
+  assert_int_equal(asic_focus_compute(&focus, points, 2, &frame), kAsiceSuccess);
+  for (uint16_t channel = 0; channel < 4; channel++) {
+    uint16_t error = (frame.delay[1][channel] - delays[channel] + 2) & 1023;
+    assert_in_range(error, 0, 4);
+    assert_in_range(frame.duty[1][channel], 254, 256);
+  }
+
+  /* Points adding up to more than full amplitude are scaled down to full duty */
+  points[0].amplitude = ASIC_FOCUS_AMPLITUDE_MAX / 2;
+  points[1].amplitude = ASIC_FOCUS_AMPLITUDE_MAX / 2;
+  assert_int_equal(asic_focus_compute(&focus, points, 2, &frame), kAsiceSuccess);
+  assert_in_range(frame.duty[1][0], 510, 512);
+  points[0].amplitude = ASIC_FOCUS_AMPLITUDE_MAX;
+  points[1].amplitude = ASIC_FOCUS_AMPLITUDE_MAX;
+  assert_int_equal(asic_focus_compute(&focus, points, 2, &frame), kAsiceSuccess);
+  assert_in_range(frame.duty[1][0], 510, 512);
+
+  /* Points half a wavelength apart cancel at a transducer in line with both */
+  points[1].z = 44000;
+  assert_int_equal(asic_focus_compute(&focus, points, 2, &frame), kAsiceSuccess);
+  assert_in_range(frame.duty[1][0], 0, 2);
+  assert_int_equal(asic_focus_compute(&focus, points, ASIC_FOCUS_MAX_POINTS + 1, &frame),
+                   kAsiceERR);
+}
+
+static void test_asic_spi_adc_stream(void** state) {
+  (void)state; /* Unused */
+
+  static const ADCChannels channels[] = {kADCChannel_hv, kADCChannel_1V8};
+  static asic_adc_stream stream;
+  static asic_adc_sample ring[4];
+  g_asic_sim.adc_conversion_frames = 1;
+  assert_int_equal(asic_adc_stream_init(&stream, ring, 4, 2), kAsiceSuccess);
+  asic_adc_stream_set_clock(&stream, sim_clock);
+
+  /* Two scans of two channels on two asics, averaged in pairs into four samples */
+  for (uint16_t scan = 0; scan < 2; scan++) {
+    for (uint8_t address = 0; address < 2; address++) {
+      g_asic_sim.adc_input[address][kADCChannel_hv] = 0x100 + (address * 0x10) + (scan * 4);
+      g_asic_sim.adc_input[address][kADCChannel_1V8] = 0x200 + address;
+    }
+    assert_int_equal(asic_adc_stream_acquire(&stream, channels, 2, 0x03), kAsiceSuccess);
+  }
+
+  const asic_adc_sample* samples;
+  assert_int_equal(asic_adc_stream_peek(&stream, &samples), 4);
+  assert_ptr_equal(samples, &ring[0]);
+  assert_int_equal(samples[0].address, 0);
+  assert_int_equal(samples[0].channel, kADCChannel_hv);
+  assert_int_equal(samples[0].value, 0x102);
+  assert_int_equal(samples[1].value, 0x112);
+  assert_int_equal(samples[3].address, 1);
+  assert_int_equal(samples[3].channel, kADCChannel_1V8);
+  assert_int_equal(samples[3].value, 0x201);
+  assert_true(0 < samples[0].time);
+  assert_true(samples[0].time <= samples[3].time);
+
+  /* Full ring drops the newest samples, the producer never waits */
+  assert_int_equal(asic_adc_stream_acquire(&stream, channels, 2, 0x03), kAsiceSuccess);
+  assert_int_equal(asic_adc_stream_acquire(&stream, channels, 2, 0x03), kAsiceSuccess);
+  assert_int_equal(atomic_load(&stream.overruns), 4);
+
+  /* Released samples are refilled in place, a run stops at the end of the ring */
+  asic_adc_stream_release(&stream, 3);
+  for (uint16_t reading = 0; reading < 4; reading++) {
+    asic_adc_stream_push(&stream, 2, kADCChannel_LoadSense, 0x300 + reading);
+  }
+  assert_int_equal(asic_adc_stream_peek(&stream, &samples), 1);
+  assert_ptr_equal(samples, &ring[3]);
+  asic_adc_stream_release(&stream, 1);
+  assert_int_equal(asic_adc_stream_peek(&stream, &samples), 2);
+  assert_ptr_equal(samples, &ring[0]);
+  assert_int_equal(samples[0].address, 2);
+  assert_int_equal(samples[1].value, 0x303);
+
+  /* Statistics cover every reading, decimated or not */
+  asic_adc_stats stats;
+  assert_int_equal(asic_adc_stream_stats(&stream, 0, kADCChannel_hv, &stats), kAsiceSuccess);
+  assert_int_equal(stats.count, 4);
+  assert_int_equal(stats.min, 0x100);
+  assert_int_equal(stats.max, 0x104);
+  assert_int_equal(stats.mean, 0x103);
+  asic_adc_stream_stats_reset(&stream);
+  asic_adc_stream_push(&stream, 0, kADCChannel_hv, 0x0050);
+  assert_int_equal(asic_adc_stream_stats(&stream, 0, kADCChannel_hv, &stats), kAsiceSuccess);
+  assert_int_equal(stats.count, 1);
+  assert_int_equal(stats.min, 0x0050);
+  assert_int_equal(stats.mean, 0x0050);
+
+  /* Out of range asics and channels are refused, not wrapped onto another channel */
+  assert_int_equal(asic_adc_stream_stats(&stream, ASIC_MAX_DEVICES, kADCChannel_hv, &stats),
+                   kAsiceERR);
+  assert_int_equal(asic_adc_stream_stats(&stream, 0, kADCChannel_Total, &stats), kAsiceERR);
+
+  /* A reader that interrupted the producer mid update gives up instead of spinning, readers of
+   * other channels are not held off */
+  atomic_fetch_add(&stream.stats_sequence[0][kADCChannel_hv], 1);
+  assert_int_equal(asic_adc_stream_stats(&stream, 0, kADCChannel_hv, &stats), kAsiceERR);
+  assert_int_equal(asic_adc_stream_stats(&stream, 1, kADCChannel_hv, &stats), kAsiceSuccess);
+  atomic_fetch_add(&stream.stats_sequence[0][kADCChannel_hv], 1);
+  assert_int_equal(asic_adc_stream_stats(&stream, 0, kADCChannel_hv, &stats), kAsiceSuccess);
+}
+
+static void test_asic_spi_load_sense_map(void** state) {
+  (void)state; /* Unused */
+
+  for (uint8_t address = 0; address < 3; address++) {
+    g_asic_sim.regs[address][REG_ADC_LOAD_SENSE_CONFIG] = (3 << 8) | 2;
+    for (uint16_t channel = 0; channel < ASIC_LOAD_SENSE_CHANNELS; channel++) {
+      g_asic_sim.load_sense[address][channel] = (uint16_t)((address << 8) | channel);
+    }
+  }
+  g_asic_sim.adc_conversion_frames = 1;
+
+  /* Every channel of three asics, one hold of 2 + 3 + 3 pulses per channel for the chain */
+  uint16_t map[ASIC_MAX_DEVICES * ASIC_LOAD_SENSE_CHANNELS] = {0};
+  uint32_t frames = g_asic_sim.register_frames;
+  assert_int_equal(asic_adc_load_sense_map(0x07, 0xFFFF, map), kAsiceSuccess);
+  for (uint8_t address = 0; address < 3; address++) {
+    for (uint16_t channel = 0; channel < ASIC_LOAD_SENSE_CHANNELS; channel++) {
+      assert_int_equal(map[(address * ASIC_LOAD_SENSE_CHANNELS) + channel],
+                       (address << 8) | channel);
+    }
+    assert_int_equal(g_asic_sim.adc_syncs[address], ASIC_LOAD_SENSE_CHANNELS * 8);
+    assert_int_equal(g_asic_sim.adc_conversions[address], ASIC_LOAD_SENSE_CHANNELS);
+    assert_int_equal(g_asic_sim.regs[address][REG_ADC_LOAD_SENSE], 0);
+  }
+  assert_int_equal(g_asic_sim.load_sense_faults, 0);
+  assert_int_equal(map[3 * ASIC_LOAD_SENSE_CHANNELS], 0);
+
+  /* Timing and ADC state read, setup, then hold, start, done poll, read and select per channel */
+  assert_int_equal(g_asic_sim.register_frames - frames,
+                   (2 * 3) + (2 * 3) + (ASIC_LOAD_SENSE_CHANNELS * ((3 * 8) + 3 + 3 + (2 * 3))));
+
+  /* Sparse channels skip straight from one to the next */
+  assert_int_equal(asic_adc_load_sense_map(0x02, 0x8001, map), kAsiceSuccess);
+  assert_int_equal(g_asic_sim.adc_conversions[1], ASIC_LOAD_SENSE_CHANNELS + 2);
+  assert_int_equal(g_asic_sim.load_sense_faults, 0);
+
+  /* Asics with different timings can't share a hold */
+  g_asic_sim.regs[1][REG_ADC_LOAD_SENSE_CONFIG] = (4 << 8) | 2;
+  assert_int_equal(asic_adc_load_sense_map(0x03, 0x0001, map), kAsiceERR);
+}
+
+/* A sync edge handled late, while the conversion start is on the bus */
+static void late_sync_frame_hook(uint32_t frame) {
+  if ((REG_ADC_STATE == ((frame >> 18) & 0xFF)) && (0 != (frame & (1 << 3)))) {
+    asic_adc_done_isr((uint8_t)((frame >> 26) & 0x7));
+  }
+}
+
+static void test_asic_spi_load_sense_map_irq(void** state) {
+  (void)state; /* Unused */
+
+  for (uint8_t address = 0; address < 3; address++) {
+    g_asic_sim.regs[address][REG_ADC_LOAD_SENSE_CONFIG] = (3 << 8) | 2;
+    for (uint16_t channel = 0; channel < ASIC_LOAD_SENSE_CHANNELS; channel++) {
+      g_asic_sim.load_sense[address][channel] = (uint16_t)((address << 8) | channel);
+    }
+  }
+  /* Conversions outlast the start batch, and every sync edge reaches the done hook too */
+  g_asic_sim.adc_conversion_frames = 8;
+  g_asic_sim.adc_complete = asic_adc_done_isr;
+  g_asic_sim.gpio_edge = sim_gpio_edge;
+  g_asic_sim.frame_hook = late_sync_frame_hook;
+  sync_edges = 0;
+  assert_int_equal(asic_broadcast_begin(0x07), kAsiceSuccess);
+  assert_int_equal(asic_adc_done_irq_enable(1), kAsiceSuccess);
+  assert_int_equal(asic_broadcast_end(), kAsiceSuccess);
+
+  uint16_t map[ASIC_MAX_DEVICES * ASIC_LOAD_SENSE_CHANNELS] = {0};
+  assert_int_equal(asic_adc_load_sense_map(0x07, 0xFFFF, map), kAsiceSuccess);
+  assert_int_equal(sync_edges, 3 * ASIC_LOAD_SENSE_CHANNELS * 8);
+
+  /* No reading is taken before its own conversion has finished */
+  for (uint8_t address = 0; address < 3; address++) {
+    for (uint16_t channel = 0; channel < ASIC_LOAD_SENSE_CHANNELS; channel++) {
+      assert_int_equal(map[(address * ASIC_LOAD_SENSE_CHANNELS) + channel],
+                       (address << 8) | channel);
+    }
+    assert_int_equal(g_asic_sim.adc_conversions[address], ASIC_LOAD_SENSE_CHANNELS);
+  }
+  g_asic_sim.frame_hook = NULL;
+  asic_adc_done_irq_disable();
+}
+
+#ifdef ASIC_INSTRUMENTATION
+static uint32_t stats_total(const uint32_t* histogram) {
+  uint32_t total = 0;
+  for (uint32_t bucket = 0; bucket < ASIC_STATS_BUCKETS; bucket++) {
+    total += histogram[bucket];
+  }
+  return total;
+}
+
+static void test_asic_spi_stats(void** state) {
+  (void)state; /* Unused */
+
+  asic_stats_set_clock(sim_clock);
+  assert_int_equal(asic_setAddress(1), kAsiceSuccess);
+  asic_stats_reset();
+
+  /* One write and one read on asic 1, then a batch of two writes on asic 2 */
+  uint16_t data;
+  uint32_t frames[2];
+  asic_batch batch;
+  assert_int_equal(asic_write(REG_PWM0_DUTY, 5), kAsiceSuccess);
+  assert_int_equal(asic_read(REG_PWM0_DELAY, &data), kAsiceSuccess);
+  assert_int_equal(asic_batch_begin(&batch, frames, 2), kAsiceSuccess);
+  assert_int_equal(asic_batch_write_to(&batch, 2, REG_PWM0_DUTY, 1), kAsiceSuccess);
+  assert_int_equal(asic_batch_write_to(&batch, 2, REG_PWM0_DELAY, 2), kAsiceSuccess);
+  assert_int_equal(asic_batch_submit(&batch), kAsiceSuccess);
+
+  asic_stats stats;
+  asic_stats_snapshot(&stats);
+  assert_int_equal(stats.transfers, 3);
+  assert_int_equal(stats.frames, 4);
+  assert_int_equal(stats.reset_frames, 4);
+  assert_int_equal(stats.writes[REG_PWM0_DUTY], 2);
+  assert_int_equal(stats.writes[REG_PWM0_DELAY], 1);
+  assert_int_equal(stats.reads[REG_PWM0_DELAY], 1);
+  assert_int_equal(stats.reads[REG_PWM0_DUTY], 0);
+  assert_int_equal(stats.device_writes[1], 1);
+  assert_int_equal(stats.device_writes[2], 2);
+  assert_int_equal(stats.device_reads[1], 1);
+  assert_int_equal(stats.device_reads[2], 0);
+
+  /* The write locks once, the read and batch again to wait for completion */
+  assert_int_equal(stats_total(stats.lock_wait), 1 + 2 + 2);
+  assert_int_equal(stats.lock_wait[0], 1 + 2 + 2);
+  assert_int_equal(stats_total(stats.latency), 3);
+  assert_int_equal(stats.latency[0], 0);
+  assert_true(0 < stats.latency_max);
+  assert_true(stats.latency_max <= stats.busy_time);
+
+  /* Reset clears every counter and keeps the clock */
+  asic_stats_reset();
+  asic_stats_snapshot(&stats);
+  assert_true(sim_clock == stats.timestamp);
+  assert_int_equal(stats.transfers, 0);
+  assert_int_equal(stats.frames, 0);
+  assert_int_equal(stats.reset_frames, 0);
+  assert_int_equal(stats.writes[REG_PWM0_DUTY], 0);
+  assert_int_equal(stats.reads[REG_PWM0_DELAY], 0);
+  assert_int_equal(stats.device_writes[2], 0);
+  assert_int_equal(stats.device_reads[1], 0);
+  assert_int_equal(stats_total(stats.lock_wait), 0);
+  assert_int_equal(stats_total(stats.latency), 0);
+  assert_int_equal(stats.latency_max, 0);
+  assert_int_equal(stats.busy_time, 0);
+  asic_stats_set_clock(NULL);
 }
+#endif
 
 int main(void) {
   const struct CMUnitTest tests[] = {
       cmocka_unit_test(test_asic_spi_init),
-      cmocka_unit_test(test_asic_spi_basic_write),
-      cmocka_unit_test(test_asic_spi_basic_read),
+      cmocka_unit_test_setup(test_asic_spi_basic_write, setup),
+      cmocka_unit_test_setup(test_asic_spi_basic_read, setup),
+      cmocka_unit_test_setup(test_asic_spi_read_burst, setup),
+      cmocka_unit_test_setup(test_asic_spi_batch, setup),
+      cmocka_unit_test_setup(test_asic_spi_pwm_sync, setup),
+      cmocka_unit_test_setup(test_asic_spi_adc_sample, setup),
+      cmocka_unit_test_setup(test_asic_spi_short_detect, setup),
+      cmocka_unit_test_setup(test_asic_spi_adc_scan_irq, setup),
+      cmocka_unit_test_setup(test_asic_spi_adc_sync_edges, setup),
+      cmocka_unit_test_setup(test_asic_spi_adc_done_fallback, setup),
+      cmocka_unit_test_setup(test_asic_spi_link_training, setup),
+      cmocka_unit_test_setup(test_asic_spi_retransmit, setup),
+      cmocka_unit_test_setup(test_asic_spi_short_monitor, setup),
+      cmocka_unit_test_setup(test_asic_spi_queue_stress, setup),
+      cmocka_unit_test_setup(test_asic_spi_sched_preempt, setup),
+      cmocka_unit_test_setup(test_asic_spi_stage_commit, setup),
+      cmocka_unit_test_setup(test_asic_spi_async_shadow, setup),
+      cmocka_unit_test_setup(test_asic_spi_frame_submit, setup),
+      cmocka_unit_test_setup(test_asic_spi_stream_try_lock, setup),
+      cmocka_unit_test(test_asic_spi_focus),
+      cmocka_unit_test_setup(test_asic_spi_adc_stream, setup),
+      cmocka_unit_test_setup(test_asic_spi_load_sense_map, setup),
+      cmocka_unit_test_setup(test_asic_spi_load_sense_map_irq, setup),
+#ifdef ASIC_INSTRUMENTATION
+      cmocka_unit_test_setup(test_asic_spi_stats, setup),
+#endif
   };
   return cmocka_run_group_tests(tests, NULL, NULL);
 }